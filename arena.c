@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK (64 * 1024)
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+static ArenaBlock *new_block(Arena *arena, size_t size) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->next = arena->blocks;
+    block->size = size;
+    block->used = 0;
+    arena->blocks = block;
+    arena->block_allocations++;
+
+    return block;
+}
+
+// Returns NULL when out of memory. Memory is aligned for any scalar type.
+void *arena_alloc(Arena *arena, size_t bytes) {
+    ArenaBlock *block = arena->blocks;
+    size_t rounded = (bytes + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    if (rounded < bytes) {
+        return NULL;
+    }
+
+    if (block == NULL || block->size - block->used < rounded) {
+        // Grow geometrically so a round needs few blocks
+        size_t size = block == NULL ? ARENA_MIN_BLOCK : block->size * 2;
+
+        if (size < rounded) {
+            size = rounded;
+        }
+
+        if ((block = new_block(arena, size)) == NULL) {
+            return NULL;
+        }
+    }
+
+    void *memory = block->data + block->used;
+
+    block->used += rounded;
+    arena->used += rounded;
+    arena->allocations++;
+
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+
+    return memory;
+}
+
+void *arena_calloc(Arena *arena, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+
+    void *memory = arena_alloc(arena, count * size);
+
+    if (memory != NULL) {
+        memset(memory, 0, count * size);
+    }
+
+    return memory;
+}
+
+// Releases every allocation. If the last round spilled over several blocks
+// they are merged into one, so the next round of the same size is all
+// pointer bumps.
+void arena_reset(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+
+    arena->used = 0;
+
+    if (block == NULL) {
+        return;
+    }
+
+    if (block->next == NULL) {
+        block->used = 0;
+        return;
+    }
+
+    size_t total = 0;
+
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+
+        total += block->size;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    new_block(arena, total);
+}
+
+void arena_free(Arena *arena) {
+    while (arena->blocks != NULL) {
+        ArenaBlock *next = arena->blocks->next;
+
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+
+    arena->used = 0;
+}
@@ -0,0 +1,23 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator. Allocations live until the arena is reset, which
+// releases all of them at once and keeps the memory for the next round.
+typedef struct {
+    ArenaBlock *blocks; // Newest first, only the newest has room left
+    size_t used; // Bytes handed out since the last reset
+    size_t peak; // Most bytes in use between two resets
+    size_t allocations; // Calls to arena_alloc
+    size_t block_allocations; // Calls to malloc for blocks
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t bytes);
+void *arena_calloc(Arena *arena, size_t count, size_t size);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+#endif
@@ -1,10 +1,12 @@
 #version 120
 
 varying vec2 texCoord;
+varying vec2 tile;
 varying vec4 N, V, L;
 varying float distance;
 
 uniform sampler2D texture;
+uniform float tex_size;
 uniform int use_ambient, use_diffuse, use_specular, use_flashlight, lighting_enabled;
 uniform float attenuation_constant, attenuation_linear, attenuation_quadratic;
 uniform vec4 player_position;
@@ -13,8 +15,11 @@ vec4 ambient, diffuse, specular;
 
 void main()
 {
+	// Merged quads repeat their tile once per block
+	vec2 atlasCoord = (tile + fract(texCoord)) * tex_size;
+
 	if(lighting_enabled == 1) {
-		vec4 the_color = texture2D(texture, texCoord);
+		vec4 the_color = texture2D(texture, atlasCoord);
 		vec4 NN = normalize(N);
 		vec4 LL = normalize(L);
 		vec4 VV = normalize(V);
@@ -46,5 +51,5 @@ void main()
 		}
 	}
 	else
-		gl_FragColor = texture2D(texture, texCoord);
+		gl_FragColor = texture2D(texture, atlasCoord);
 }
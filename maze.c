@@ -21,13 +21,26 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
 #include <time.h>
 #include <unistd.h>
 #include <math.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include "initShader.h"
 #include "myLib.h"
 #include "maze_algorithms.h"
+#include "rng.h"
+#include "maze_file.h"
+#include "maze_export.h"
+#include "maze_validate.h"
+#include "maze_solver.h"
+#include "maze_graph.h"
+#include "world.h"
 
 #define IDENTITY_M4 {{1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1}}
 #define MICROSECONDS_PER_SECOND 1000000
@@ -41,12 +54,6 @@ typedef struct {
     vec2 z_neg;
 } Block;
 
-typedef struct Coordinate {
-    int x;
-    int y;
-    struct Coordinate *next;
-} Coordinate;
-
 typedef struct {
     vec4 eye, at, up;
 } view_position;
@@ -68,11 +75,25 @@ vec2 TEXTURE_BRICKS = { 3, 1 };
 vec2 TEXTURE_BIRCH_PLANKS = { 3, 2 };
 vec2 TEXTURE_DIRT = { 3, 3 };
 
-Block BLOCK_GRASS;
-Block BLOCK_DIRT;
-Block BLOCK_BIRCH_PLANKS;
-Block BLOCK_BRICKS;
-Block BLOCK_STONE_BRICKS;
+Block block_types[BLOCK_COUNT]; // Textures of each block id
+
+// Corners of each face, as offsets from the block's minimum corner
+const int FACE_CORNERS[6][4][3] = {
+    { { 1, 0, 0 }, { 1, 1, 0 }, { 1, 0, 1 }, { 1, 1, 1 } },
+    { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 1 } },
+    { { 0, 1, 0 }, { 0, 1, 1 }, { 1, 1, 0 }, { 1, 1, 1 } },
+    { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 0, 1 }, { 1, 0, 1 } },
+    { { 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 } },
+    { { 0, 0, 0 }, { 0, 1, 0 }, { 1, 0, 0 }, { 1, 1, 0 } }
+};
+
+// Corners of the two triangles of a face
+const int FACE_TRIANGLES[6] = { 0, 1, 2, 3, 2, 1 };
+
+// Axes the texture's u and v run along on each face. Both run against
+// the axis, vshader.glsl derives them from the position.
+const int FACE_TEX_AXES[6][2] = { { 2, 1 }, { 2, 1 }, { 0, 2 }, { 0, 2 }, { 0, 1 }, { 0, 1 } };
+
 
 #define get_left_direction(direction) (direction == 0 ? 3 : direction - 1)
 #define get_right_direction(direction) (direction == 3 ? 0 : direction + 1)
@@ -85,11 +106,34 @@ Block BLOCK_STONE_BRICKS;
 #define WALL_HEIGHT 5
 #define REMOVE_DIST 2
 
+// Larger mazes are not printed to the console at startup
+#define PRINT_MAZE_MAX_CELLS 10000
+
 // Texture constants
 float TEX_SIZE = 0.25;
 
+// Random stream domains
+#define STREAM_ISLAND 1
+#define STREAM_WALL 2
+#define STREAM_QUERY 3
+
+// Command line options
+uint64_t seed;
+int thread_count = 0; // 0 uses every core
+int generator = GENERATOR_RECURSIVE;
+const char *ascii_path; // Write the maze as text here instead of opening a window
+const char *pbm_path; // Write the maze as a PBM image instead of opening a window
+const char *pgm_path; // Write the maze as a PGM image instead of opening a window
+const char *validate_path; // Write a validation report instead of opening a window
+const char *save_path; // Write the maze as a .maze file instead of opening a window
+const char *load_path; // Use a .maze file instead of generating
+int verify_load = 0;
+size_t query_count = 0; // Random path queries to solve instead of opening a window
+int solve_method = -1; // Search timed from the entrance to the exit instead of opening a window
+double navigation_speed = 8; // Cells per second when walking whole corridors
+
 // Maze
-Cell **maze;
+Maze *maze;
 int maze_width;
 int maze_height;
 int left, right, bottom, top, near, far; // Island bounds
@@ -102,15 +146,106 @@ int maze_y;
 int player_facing; // 0: Pos x, 1: Pos y, 2: Neg x, 3: Neg y 
 
 // Automatic maze navigation
-struct Coordinate *path;
-struct Coordinate *current_step;
+Arena path_arena; // Holds the path, reset before each solve
+Arena search_arena; // Search memory of a solve, freed when the solve ends
+MazePath path = { .arena = &path_arena, .scratch = &search_arena };
+size_t path_step; // Index of the player's cell in path
+size_t path_segment; // Index of the next straight run in path
+int path_fast; // The path is walked by straight runs, fixed when the walk starts
+int fast_navigation = 0; // Walk each straight run of a path as one move
+DirectionField exit_field; // Built once, solves are then a walk to the exit
+MazeGraph junction_graph; // Corridors collapsed into edges between junctions and dead ends, built if needed
+int junction_graph_tried = 0;
 
 // OpenGL buffers
 size_t num_vertices;
-size_t vertex_index = 0;
-vec4 *positions;
-vec4 *normals;
-vec2 *tex_coords;
+size_t num_indices;
+size_t face_index = 0; // Faces written so far, 4 vertices and 6 indices each
+// Packed vertex, the shaders rebuild the normal and texture coordinates
+// from the face and position
+typedef struct {
+    GLshort x, y, z;
+    GLubyte face;
+    GLubyte tile; // Atlas tile, x + y * tiles per row
+} BlockVertex;
+
+GLenum index_type; // GL_UNSIGNED_SHORT when every index fits
+GLuint world_vertex_buffer;
+GLuint world_index_buffer;
+
+// The mesh is written a batch of chunks at a time to a staging area and
+// uploaded from there, so it is never held whole in memory
+#define STAGING_FACES 65536
+
+BlockVertex *vertices; // Staging area, face staging_first_face is written first
+GLuint *indices; // Holds GLushort indices when index_type is GL_UNSIGNED_SHORT
+size_t staging_first_face;
+
+// Block drawn as an instance of one cube
+typedef struct {
+    GLint x, y, z;
+    GLint block;
+} BlockInstance;
+
+int instanced_rendering = 0; // Draw blocks as cube instances instead of meshing the world
+BlockInstance *instances;
+size_t num_instances;
+GLuint world_vao;
+GLuint instance_vao;
+GLuint instanced_location;
+
+// Blocks of the island and maze, meshed once they are all placed
+World world;
+
+// Rectangle of merged faces. It is width faces long along the face's u
+// axis and height along v, all with the same texture.
+typedef struct {
+    int x, y, z; // Minimum block
+    int width, height;
+    int face;
+    vec2 texture;
+} FaceQuad;
+
+// The world is meshed in columns of CHUNK_SIZE x CHUNK_SIZE blocks. Each
+// chunk is a range of the index buffer per level of detail and is only
+// drawn when its box is in view. Level l stands cubes of 2^l blocks in for
+// single blocks, and is drawn once those cubes look small enough. A cube
+// is solid when any block in it is, so coarse surfaces stand above the
+// finer ones next to them; coarse chunks therefore close off their sides
+// so the step between them shows no cracks.
+#define CHUNK_SIZE 16
+#define LOD_LEVELS 3
+#define LOD_PIXELS 2.0 // Largest a cube of a coarse level may look, in pixels
+
+typedef struct {
+    size_t first_index[LOD_LEVELS];
+    size_t index_count[LOD_LEVELS];
+    vec4 min, max; // Bounding box of the faces of every level
+    size_t visible; // Block faces that went into the full detail quads
+    int level; // Level drawn this frame
+} WorldChunk;
+
+// Quads merged by one job
+typedef struct {
+    FaceQuad *quads;
+    size_t count;
+    size_t capacity;
+} QuadList;
+
+WorldChunk *chunks;
+size_t num_chunks;
+int chunks_x; // Chunk (x, z) is chunks[x + z * chunks_x], counted from the world's minimum
+
+// Chunks in sight of an eye inside the maze, below the tops of the walls.
+// The walls then hide everything but the cells it can see into through
+// the openings between them, and the tops of walls further on that show
+// over them.
+size_t *seen_chunks;
+size_t seen_count;
+unsigned *chunk_seen_frame; // Frame a chunk was last added to seen_chunks
+unsigned seen_frame;
+int outside_seen; // An opening in the outer walls is in sight
+float sight_reach; // How many times further than a wall the tops of the walls behind it show
 
 GLuint light_position_location;
 
@@ -161,202 +296,75 @@ int is_first_rotation = 1;
 
 int is_animating = 0;
 long animation_started;
+long animation_duration; // Microseconds
 vec4 eye_move_vector;
 vec4 at_move_vector;
 
 view_position current_pos, target_pos;
 
 void define_blocks() {
-    BLOCK_GRASS = (Block) { TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_TOP, TEXTURE_DIRT, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE };
-    BLOCK_DIRT = (Block) { TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT };
-    BLOCK_BIRCH_PLANKS = (Block) { TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS };
-    BLOCK_BRICKS = (Block) { TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS };
-    BLOCK_STONE_BRICKS = (Block) { TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS };
-
-}
-
-void set_cube_vertices(int index, float x1, float y1, float z1, float size) {
-    float x2 = x1 + size;
-    float y2 = y1 + size;
-    float z2 = z1 + size;
-
-    // X+
-    positions[index] = (vec4) { x2, y1, z1, 1.0 };
-    positions[index + 1] = (vec4) { x2, y2, z1, 1.0 };
-    positions[index + 2] = (vec4) { x2, y1, z2, 1.0 };
-    positions[index + 3] = (vec4) { x2, y2, z2, 1.0 };
-    positions[index + 4] = (vec4) { x2, y1, z2, 1.0 };
-    positions[index + 5] = (vec4) { x2, y2, z1, 1.0 };
-
-    // X-
-    positions[index + 6] = (vec4) { x1, y1, z1, 1.0 };
-    positions[index + 7] = (vec4) { x1, y1, z2, 1.0 };
-    positions[index + 8] = (vec4) { x1, y2, z1, 1.0 };
-    positions[index + 9] = (vec4) { x1, y2, z2, 1.0 };
-    positions[index + 10] = (vec4) { x1, y2, z1, 1.0 };
-    positions[index + 11] = (vec4) { x1, y1, z2, 1.0 };
-
-    // Y+
-    positions[index + 12] = (vec4) { x1, y2, z1, 1.0 };
-    positions[index + 13] = (vec4) { x1, y2, z2, 1.0 };
-    positions[index + 14] = (vec4) { x2, y2, z1, 1.0 };
-    positions[index + 15] = (vec4) { x2, y2, z2, 1.0 };
-    positions[index + 16] = (vec4) { x2, y2, z1, 1.0 };
-    positions[index + 17] = (vec4) { x1, y2, z2, 1.0 };
-
-    // Y-
-    positions[index + 18] = (vec4) { x1, y1, z1, 1.0 };
-    positions[index + 19] = (vec4) { x2, y1, z1, 1.0 };
-    positions[index + 20] = (vec4) { x1, y1, z2, 1.0 };
-    positions[index + 21] = (vec4) { x2, y1, z2, 1.0 };
-    positions[index + 22] = (vec4) { x1, y1, z2, 1.0 };
-    positions[index + 23] = (vec4) { x2, y1, z1, 1.0 };
-
-    // Z+
-    positions[index + 24] = (vec4) { x1, y1, z2, 1.0 };
-    positions[index + 25] = (vec4) { x2, y1, z2, 1.0 };
-    positions[index + 26] = (vec4) { x1, y2, z2, 1.0 };
-    positions[index + 27] = (vec4) { x2, y2, z2, 1.0 };
-    positions[index + 28] = (vec4) { x1, y2, z2, 1.0 };
-    positions[index + 29] = (vec4) { x2, y1, z2, 1.0 };
-
-    // Z-
-    positions[index + 30] = (vec4) { x1, y1, z1, 1.0 };
-    positions[index + 31] = (vec4) { x1, y2, z1, 1.0 };
-    positions[index + 32] = (vec4) { x2, y1, z1, 1.0 };
-    positions[index + 33] = (vec4) { x2, y2, z1, 1.0 };
-    positions[index + 34] = (vec4) { x2, y1, z1, 1.0 };
-    positions[index + 35] = (vec4) { x1, y2, z1, 1.0 };
-}
-
-void set_cube_normals(int index) {
-    // X+
-    normals[index] = (vec4) { 1.0, 0.0, 0.0, 1.0 };
-    normals[index + 1] = (vec4) { 1.0, 0.0, 0.0, 1.0 };
-    normals[index + 2] = (vec4) { 1.0, 0.0, 0.0, 1.0 };
-    normals[index + 3] = (vec4) { 1.0, 0.0, 0.0, 1.0 };
-    normals[index + 4] = (vec4) { 1.0, 0.0, 0.0, 1.0 };
-    normals[index + 5] = (vec4) { 1.0, 0.0, 0.0, 1.0 };
-
-    // X-
-    normals[index + 6] = (vec4) { -1.0, 0.0, 0.0, 1.0 };
-    normals[index + 7] = (vec4) { -1.0, 0.0, 0.0, 1.0 };
-    normals[index + 8] = (vec4) { -1.0, 0.0, 0.0, 1.0 };
-    normals[index + 9] = (vec4) { -1.0, 0.0, 0.0, 1.0 };
-    normals[index + 10] = (vec4) { -1.0, 0.0, 0.0, 1.0 };
-    normals[index + 11] = (vec4) { -1.0, 0.0, 0.0, 1.0 };
-
-    // Y+
-    normals[index + 12] = (vec4) { 0.0, 1.0, 0.0, 1.0 };
-    normals[index + 13] = (vec4) { 0.0, 1.0, 0.0, 1.0 };
-    normals[index + 14] = (vec4) { 0.0, 1.0, 0.0, 1.0 };
-    normals[index + 15] = (vec4) { 0.0, 1.0, 0.0, 1.0 };
-    normals[index + 16] = (vec4) { 0.0, 1.0, 0.0, 1.0 };
-    normals[index + 17] = (vec4) { 0.0, 1.0, 0.0, 1.0 };
-
-    // Y-
-    normals[index + 18] = (vec4) { 0.0, -1.0, 0.0, 1.0 };
-    normals[index + 19] = (vec4) { 0.0, -1.0, 0.0, 1.0 };
-    normals[index + 20] = (vec4) { 0.0, -1.0, 0.0, 1.0 };
-    normals[index + 21] = (vec4) { 0.0, -1.0, 0.0, 1.0 };
-    normals[index + 22] = (vec4) { 0.0, -1.0, 0.0, 1.0 };
-    normals[index + 23] = (vec4) { 0.0, -1.0, 0.0, 1.0 };
-
-    // Z+
-    normals[index + 24] = (vec4) { 0.0, 0.0, 1.0, 1.0 };
-    normals[index + 25] = (vec4) { 0.0, 0.0, 1.0, 1.0 };
-    normals[index + 26] = (vec4) { 0.0, 0.0, 1.0, 1.0 };
-    normals[index + 27] = (vec4) { 0.0, 0.0, 1.0, 1.0 };
-    normals[index + 28] = (vec4) { 0.0, 0.0, 1.0, 1.0 };
-    normals[index + 29] = (vec4) { 0.0, 0.0, 1.0, 1.0 };
-
-    // Z-
-    normals[index + 30] = (vec4) { 0.0, 0.0, -1.0, 1.0 };
-    normals[index + 31] = (vec4) { 0.0, 0.0, -1.0, 1.0 };
-    normals[index + 32] = (vec4) { 0.0, 0.0, -1.0, 1.0 };
-    normals[index + 33] = (vec4) { 0.0, 0.0, -1.0, 1.0 };
-    normals[index + 34] = (vec4) { 0.0, 0.0, -1.0, 1.0 };
-    normals[index + 35] = (vec4) { 0.0, 0.0, -1.0, 1.0 };
-}
-
-void set_cube_texture(int index, vec2 x_pos, vec2 x_neg, vec2 y_pos, vec2 y_neg, vec2 z_pos, vec2 z_neg) {
-    // X+
-    float x1 = TEX_SIZE * x_pos.x;
-    float y1 = TEX_SIZE * x_pos.y;
-    float x2 = x1 + TEX_SIZE;
-    float y2 = y1 + TEX_SIZE;
-    
-    tex_coords[index] = (vec2) { x2, y2 };
-    tex_coords[index + 1] = (vec2) { x2, y1 };
-    tex_coords[index + 2] = (vec2) { x1, y2 };
-    tex_coords[index + 3] = (vec2) { x1, y1 };
-    tex_coords[index + 4] = (vec2) { x1, y2 };
-    tex_coords[index + 5] = (vec2) { x2, y1 };
-
-    // X-
-    x1 = TEX_SIZE * x_neg.x;
-    y1 = TEX_SIZE * x_neg.y;
-    x2 = x1 + TEX_SIZE;
-    y2 = y1 + TEX_SIZE;
-
-    tex_coords[index + 6] = (vec2) { x2, y2 };
-    tex_coords[index + 7] = (vec2) { x1, y2 };
-    tex_coords[index + 8] = (vec2) { x2, y1 };
-    tex_coords[index + 9] = (vec2) { x1, y1 };
-    tex_coords[index + 10] = (vec2) { x2, y1 };
-    tex_coords[index + 11] = (vec2) { x1, y2 };
-
-    // Y+
-    x1 = TEX_SIZE * y_pos.x;
-    y1 = TEX_SIZE * y_pos.y;
-    x2 = x1 + TEX_SIZE;
-    y2 = y1 + TEX_SIZE;
-    
-    tex_coords[index + 12] = (vec2) { x2, y2 };
-    tex_coords[index + 13] = (vec2) { x2, y1 };
-    tex_coords[index + 14] = (vec2) { x1, y2 };
-    tex_coords[index + 15] = (vec2) { x1, y1 };
-    tex_coords[index + 16] = (vec2) { x1, y2 };
-    tex_coords[index + 17] = (vec2) { x2, y1 };
-
-    // Y-
-    x1 = TEX_SIZE * y_neg.x;
-    y1 = TEX_SIZE * y_neg.y;
-    x2 = x1 + TEX_SIZE;
-    y2 = y1 + TEX_SIZE;
-
-    tex_coords[index + 18] = (vec2) { x2, y2 };
-    tex_coords[index + 19] = (vec2) { x1, y2 };
-    tex_coords[index + 20] = (vec2) { x2, y1 };
-    tex_coords[index + 21] = (vec2) { x1, y1 };
-    tex_coords[index + 22] = (vec2) { x2, y1 };
-    tex_coords[index + 23] = (vec2) { x1, y2 };
-
-    // Z+
-    x1 = TEX_SIZE * z_pos.x;
-    y1 = TEX_SIZE * z_pos.y;
-    x2 = x1 + TEX_SIZE;
-    y2 = y1 + TEX_SIZE;
-
-    tex_coords[index + 24] = (vec2) { x2, y2 };
-    tex_coords[index + 25] = (vec2) { x1, y2 };
-    tex_coords[index + 26] = (vec2) { x2, y1 };
-    tex_coords[index + 27] = (vec2) { x1, y1 };
-    tex_coords[index + 28] = (vec2) { x2, y1 };
-    tex_coords[index + 29] = (vec2) { x1, y2 };
-
-    // Z-
-    x1 = TEX_SIZE * z_neg.x;
-    y1 = TEX_SIZE * z_neg.y;
-    x2 = x1 + TEX_SIZE;
-    y2 = y1 + TEX_SIZE;
-
-    tex_coords[index + 30] = (vec2) { x2, y2 };
-    tex_coords[index + 31] = (vec2) { x2, y1 };
-    tex_coords[index + 32] = (vec2) { x1, y2 };
-    tex_coords[index + 33] = (vec2) { x1, y1 };
-    tex_coords[index + 34] = (vec2) { x1, y2 };
-    tex_coords[index + 35] = (vec2) { x2, y1 };
+    block_types[BLOCK_GRASS] = (Block) { TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_TOP, TEXTURE_DIRT, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE };
+    block_types[BLOCK_DIRT] = (Block) { TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT };
+    block_types[BLOCK_BIRCH_PLANKS] = (Block) { TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS, TEXTURE_BIRCH_PLANKS };
+    block_types[BLOCK_BRICKS] = (Block) { TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS, TEXTURE_BRICKS };
+    block_types[BLOCK_STONE_BRICKS] = (Block) { TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS };
+
+}
+
+vec2 block_face_texture(Block block, int face) {
+    switch (face) {
+        case FACE_X_POS:
+            return block.x_pos;
+        case FACE_X_NEG:
+            return block.x_neg;
+        case FACE_Y_POS:
+            return block.y_pos;
+        case FACE_Y_NEG:
+            return block.y_neg;
+        case FACE_Z_POS:
+            return block.z_pos;
+        default:
+            return block.z_neg;
+    }
+}
+
+// Writes the 4 vertices and 6 indices of a quad. The texture repeats once
+// per block, the fragment shader wraps the coordinates into the quad's
+// atlas tile.
+void set_face(size_t face, FaceQuad quad) {
+    size_t index = face * 4;
+    size_t slot = face - staging_first_face;
+
+    int tile = quad.texture.x + quad.texture.y * (int) (1 / TEX_SIZE);
+    int size[3] = { 1, 1, 1 };
+
+    size[FACE_TEX_AXES[quad.face][0]] = quad.width;
+    size[FACE_TEX_AXES[quad.face][1]] = quad.height;
+
+    for (int i = 0; i < 4; i++) {
+        const int *corner = FACE_CORNERS[quad.face][i];
+
+        vertices[slot * 4 + i] = (BlockVertex) {
+            quad.x + corner[0] * size[0], quad.y + corner[1] * size[1], quad.z + corner[2] * size[2], quad.face, tile
+        };
+    }
+
+    for (int i = 0; i < 6; i++) {
+        if (index_type == GL_UNSIGNED_SHORT) {
+            ((GLushort *) indices)[slot * 6 + i] = index + FACE_TRIANGLES[i];
+        } else {
+            indices[slot * 6 + i] = index + FACE_TRIANGLES[i];
+        }
+    }
+}
+
+// Writes the faces of a block given by the bits of faces
+void set_block_faces(int x, int y, int z, Block block, int faces) {
+    for (int face = 0; face < 6; face++) {
+        if (faces & (1 << face)) {
+            set_face(face_index++, (FaceQuad) { x, y, z, 1, 1, face, block_face_texture(block, face) });
+        }
+    }
 }
 
 long get_micro_time() {
@@ -366,16 +374,64 @@ long get_micro_time() {
     return tv.tv_sec * MICROSECONDS_PER_SECOND + tv.tv_usec;
 }
 
-int try_probability(int numerator, int denominator) {
-    return numerator > rand() % denominator;
+// Jobs 0 to count - 1, claimed one at a time by the workers
+typedef struct {
+    void (*run)(void *context, size_t job);
+    void *context;
+    size_t count;
+    size_t next; // Claimed atomically
+} JobQueue;
+
+void *job_worker(void *arg) {
+    JobQueue *queue = arg;
+    size_t job;
+
+    while ((job = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->count) {
+        queue->run(queue->context, job);
+    }
+
+    return NULL;
 }
 
-void set_block(int x, int y, int z, Block block) {
-    set_cube_vertices(vertex_index, x, y, z, 1);
-    set_cube_normals(vertex_index);
-    set_cube_texture(vertex_index, block.x_pos, block.x_neg, block.y_pos, block.y_neg, block.z_pos, block.z_neg);
+// Runs independent jobs on thread_count threads, this one included, and
+// returns when all are done
+void run_jobs(void (*run)(void *context, size_t job), void *context, size_t count) {
+    JobQueue queue = { run, context, count, 0 };
+    int threads = thread_count > 0 ? thread_count : default_thread_count();
 
-    vertex_index += 36;
+    if ((size_t) threads > count) {
+        threads = count;
+    }
+
+    pthread_t *workers = threads > 1 ? malloc((threads - 1) * sizeof(pthread_t)) : NULL;
+    int started = 0;
+
+    if (workers != NULL) {
+        for (; started < threads - 1; started++) {
+            if (pthread_create(&workers[started], NULL, job_worker, &queue) != 0) {
+                break;
+            }
+        }
+    }
+
+    job_worker(&queue);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+}
+
+int try_probability(Rng *rng, uint32_t numerator, uint32_t denominator) {
+    return numerator > rng_below(rng, denominator);
+}
+
+void set_block(int x, int y, int z, int block) {
+    if (!world_set(&world, x, y, z, block)) {
+        printf("\nNot enough memory for the world! Exiting...\n");
+        exit(1);
+    }
 }
 
 void generate_island_column(int x, int z, int min_distance) {
@@ -387,6 +443,10 @@ void generate_island_column(int x, int z, int min_distance) {
 
     int min_y = -REMOVE_DIST - min_distance;
 
+    // Each column has its own stream so the island only depends on the seed
+    Rng rng;
+    rng_init_stream(&rng, seed, rng_key(STREAM_ISLAND, x, z));
+
     // Guaranteed blocks
     if (fill_until < 0) {
         set_block(x, 0, z, BLOCK_GRASS);
@@ -400,7 +460,7 @@ void generate_island_column(int x, int z, int min_distance) {
     int y = min_y;
 
     for (; y <= fill_until; y++) {
-        if (try_probability(1, 4)) {
+        if (try_probability(&rng, 1, 4)) {
             break;
         }
     }
@@ -414,10 +474,13 @@ void generate_island_column(int x, int z, int min_distance) {
     }
 }
 
-void generate_maze_wall(int x, int z, Block block) {
+void generate_maze_wall(int x, int z, int block) {
     int maze_top = 1 + WALL_HEIGHT;
     int random_removal_level = maze_top - REMOVE_DIST;
 
+    Rng rng;
+    rng_init_stream(&rng, seed, rng_key(STREAM_WALL, x, z));
+
     // Guaranteed blocks
     for (int y = 2; y <= random_removal_level; y++) {
         set_block(x, y, z, block);
@@ -427,7 +490,7 @@ void generate_maze_wall(int x, int z, Block block) {
     int y = maze_top;
 
     for (; y > random_removal_level; y--) {
-        if (try_probability(1, 3)) {
+        if (try_probability(&rng, 1, 3)) {
             break;
         }
     }
@@ -437,6 +500,545 @@ void generate_maze_wall(int x, int z, Block block) {
     }
 }
 
+int add_face_quad(FaceQuad **quads, size_t *count, size_t *capacity, FaceQuad quad) {
+    if (*count == *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 4096;
+        FaceQuad *new_quads = realloc(*quads, new_capacity * sizeof(FaceQuad));
+
+        if (new_quads == NULL) {
+            return 0;
+        }
+
+        *quads = new_quads;
+        *capacity = new_capacity;
+    }
+
+    (*quads)[(*count)++] = quad;
+    return 1;
+}
+
+// Block standing in for a cube of scale blocks in a coarse level: the
+// highest solid block in it, so the grass and the tops of the walls show
+int coarse_block(int x, int y, int z, int scale) {
+    for (int dy = scale - 1; dy >= 0; dy--) {
+        for (int dz = 0; dz < scale; dz++) {
+            for (int dx = 0; dx < scale; dx++) {
+                int block = world_get(&world, x + dx, y + dy, z + dz);
+
+                if (block != BLOCK_AIR) {
+                    return block;
+                }
+            }
+        }
+    }
+
+    return BLOCK_AIR;
+}
+
+void grow_chunk_box(WorldChunk *chunk, int p[3], int extent[3]) {
+    chunk->min.x = fmin(chunk->min.x, p[0]);
+    chunk->min.y = fmin(chunk->min.y, p[1]);
+    chunk->min.z = fmin(chunk->min.z, p[2]);
+    chunk->max.x = fmax(chunk->max.x, p[0] + extent[0]);
+    chunk->max.y = fmax(chunk->max.y, p[1] + extent[1]);
+    chunk->max.z = fmax(chunk->max.z, p[2] + extent[2]);
+}
+
+// Merges the faces of a chunk that border air into quads, one slice of
+// the chunk at a time. Each slice is a grid of texture keys, 0 where there
+// is no visible face, that is covered greedily with the widest rectangles.
+// The chunk and the cubes around it are first decoded from the world into
+// a plain grid with one entry per cube of the level.
+//
+// Without a list the quads are only counted into the chunk, which also
+// takes their box. With one they are added to the list.
+int merge_chunk_faces(WorldChunk *chunk, int level, int x, int z, int size_x, int size_z, QuadList *list) {
+    int scale = 1 << level;
+    int mins[3] = { x, world.min_y, z };
+    int sizes[3] = { (size_x + scale - 1) >> level, (world.size_y + scale - 1) >> level, (size_z + scale - 1) >> level };
+    size_t mask_size = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        size_t slice = (size_t) sizes[(axis + 1) % 3] * sizes[(axis + 2) % 3];
+
+        if (slice > mask_size) {
+            mask_size = slice;
+        }
+    }
+
+    // One cube of padding on every side, x fastest, then z, then y
+    size_t strides[3] = { 1, (size_t) (sizes[0] + 2) * (sizes[2] + 2), sizes[0] + 2 };
+    uint16_t *mask = malloc(mask_size * sizeof(uint16_t));
+    uint8_t *blocks = malloc(strides[1] * (sizes[1] + 2));
+
+    if (mask == NULL || blocks == NULL) {
+        free(mask);
+        free(blocks);
+        return 0;
+    }
+
+    for (int y = 0; y < sizes[1] + 2; y++) {
+        for (int z = 0; z < sizes[2] + 2; z++) {
+            for (int x = 0; x < sizes[0] + 2; x++) {
+                int side = x == 0 || z == 0 || x == sizes[0] + 1 || z == sizes[2] + 1;
+
+                // Coarse chunks face air across their sides, a finer
+                // neighbour may be lower there
+                blocks[y * strides[1] + z * strides[2] + x] = level > 0 && side ? BLOCK_AIR : coarse_block(
+                    mins[0] + (x - 1) * scale, mins[1] + (y - 1) * scale, mins[2] + (z - 1) * scale, scale);
+            }
+        }
+    }
+
+    for (int face = 0; face < 6; face++) {
+        int normal_axis = face / 2;
+        int u_axis = FACE_TEX_AXES[face][0];
+        int v_axis = FACE_TEX_AXES[face][1];
+        int u_size = sizes[u_axis];
+        int v_size = sizes[v_axis];
+        ptrdiff_t neighbour = 0;
+        uint16_t keys[BLOCK_COUNT] = { 0 };
+
+        for (int axis = 0; axis < 3; axis++) {
+            neighbour += FACE_OFFSETS[face][axis] * (ptrdiff_t) strides[axis];
+        }
+
+        for (int block = BLOCK_AIR + 1; block < BLOCK_COUNT; block++) {
+            vec2 texture = block_face_texture(block_types[block], face);
+
+            keys[block] = 1 + (int) texture.x + (int) texture.y * 256;
+        }
+
+        for (int layer = 0; layer < sizes[normal_axis]; layer++) {
+            int p[3];
+
+            for (int v = 0; v < v_size; v++) {
+                uint8_t *row = blocks + (layer + 1) * strides[normal_axis] + (v + 1) * strides[v_axis] + strides[u_axis];
+
+                for (int u = 0; u < u_size; u++) {
+                    uint8_t *block = row + u * strides[u_axis];
+                    uint16_t key = 0;
+
+                    if (*block != BLOCK_AIR && block[neighbour] == BLOCK_AIR) {
+                        key = keys[*block];
+
+                        if (list == NULL && level == 0) {
+                            chunk->visible++;
+                        }
+                    }
+
+                    mask[(size_t) v * u_size + u] = key;
+                }
+            }
+
+            for (int v = 0; v < v_size; v++) {
+                for (int u = 0; u < u_size; u++) {
+                    uint16_t key = mask[(size_t) v * u_size + u];
+
+                    if (key == 0) {
+                        continue;
+                    }
+
+                    int width = 1;
+                    int height = 1;
+
+                    while (u + width < u_size && mask[(size_t) v * u_size + u + width] == key) {
+                        width++;
+                    }
+
+                    // Grow down while the whole next row matches
+                    for (; v + height < v_size; height++) {
+                        uint16_t *row = mask + (size_t) (v + height) * u_size + u;
+                        int i = 0;
+
+                        while (i < width && row[i] == key) {
+                            i++;
+                        }
+
+                        if (i < width) {
+                            break;
+                        }
+                    }
+
+                    for (int j = 0; j < height; j++) {
+                        memset(mask + (size_t) (v + j) * u_size + u, 0, width * sizeof(uint16_t));
+                    }
+
+                    p[normal_axis] = mins[normal_axis] + layer * scale;
+                    p[u_axis] = mins[u_axis] + u * scale;
+                    p[v_axis] = mins[v_axis] + v * scale;
+
+                    if (list == NULL) {
+                        int extent[3];
+
+                        extent[normal_axis] = scale;
+                        extent[u_axis] = width * scale;
+                        extent[v_axis] = height * scale;
+                        grow_chunk_box(chunk, p, extent);
+                        chunk->index_count[level] += 6;
+                        continue;
+                    }
+
+                    // Faces are one block deep, move those on the far side of a cube to its end
+                    if (face % 2 == 0) {
+                        p[normal_axis] += scale - 1;
+                    }
+
+                    FaceQuad quad = { p[0], p[1], p[2], width * scale, height * scale, face,
+                        { (key - 1) % 256, (key - 1) / 256 } };
+
+                    if (!add_face_quad(&list->quads, &list->count, &list->capacity, quad)) {
+                        free(mask);
+                        free(blocks);
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+
+    free(mask);
+    free(blocks);
+    return 1;
+}
+
+// Lists the blocks with a face open to air, buried blocks can never be seen
+void collect_block_instances() {
+    num_instances = 0;
+
+    for (size_t pass = 0; pass < 2; pass++) {
+        size_t count = 0;
+
+        for (int y = world.min_y; y < world.min_y + world.size_y; y++) {
+            for (int z = world.min_z; z < world.min_z + world.size_z; z++) {
+                for (int x = world.min_x; x < world.min_x + world.size_x; x++) {
+                    int block = world_get(&world, x, y, z);
+
+                    if (block != BLOCK_AIR && world_visible_faces(&world, x, y, z) != 0) {
+                        if (pass == 1) {
+                            instances[count] = (BlockInstance) { x, y, z, block };
+                        }
+
+                        count++;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            instances = (BlockInstance *) malloc(sizeof(BlockInstance) * count);
+
+            if (instances == NULL) {
+                printf("\nNot enough memory for %zu block instances! Exiting...\n", count);
+                exit(1);
+            }
+        }
+
+        num_instances = count;
+    }
+
+    printf("World: %zu block instances\n", num_instances);
+}
+
+// Chunk (x, z) covers the blocks from x * CHUNK_SIZE to the end of the world
+// or of the chunk along each axis
+void chunk_box(size_t chunk, int *x, int *z, int *size_x, int *size_z) {
+    int x_offset = chunk % chunks_x * CHUNK_SIZE;
+    int z_offset = chunk / chunks_x * CHUNK_SIZE;
+
+    *x = world.min_x + x_offset;
+    *z = world.min_z + z_offset;
+    *size_x = world.size_x - x_offset < CHUNK_SIZE ? world.size_x - x_offset : CHUNK_SIZE;
+    *size_z = world.size_z - z_offset < CHUNK_SIZE ? world.size_z - z_offset : CHUNK_SIZE;
+}
+
+// Counts the quads of every level of a chunk and measures its box. Sets
+// *context when out of memory.
+void count_chunk_job(void *context, size_t job) {
+    int *failed = context;
+    WorldChunk *chunk = &chunks[job];
+    int x, z, size_x, size_z;
+
+    chunk_box(job, &x, &z, &size_x, &size_z);
+    chunk->min = (vec4) { INT_MAX, INT_MAX, INT_MAX, 1 };
+    chunk->max = (vec4) { INT_MIN, INT_MIN, INT_MIN, 1 };
+
+    for (int level = 0; level < LOD_LEVELS; level++) {
+        if (!merge_chunk_faces(chunk, level, x, z, size_x, size_z, NULL)) {
+            __atomic_store_n(failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+// The buffers hold every chunk at full detail, then every chunk at the next
+// level and so on. Part i of them is one level of one chunk.
+WorldChunk *chunk_part(size_t part, int *level) {
+    *level = part / num_chunks;
+    return &chunks[part % num_chunks];
+}
+
+// Parts written to the staging area together
+typedef struct {
+    size_t first_part;
+    int failed;
+} StagingBatch;
+
+// Merges the faces of a part again and writes the quads at their place in
+// the staging area
+void write_chunk_job(void *context, size_t job) {
+    StagingBatch *batch = context;
+    size_t part = batch->first_part + job;
+    int level;
+    WorldChunk *chunk = chunk_part(part, &level);
+    QuadList list = { NULL, 0, 0 };
+    int x, z, size_x, size_z;
+
+    chunk_box(part % num_chunks, &x, &z, &size_x, &size_z);
+
+    // A part that comes out at another size than counted would overrun
+    // the place reserved for it
+    if (!merge_chunk_faces(chunk, level, x, z, size_x, size_z, &list) || list.count != chunk->index_count[level] / 6) {
+        __atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+        free(list.quads);
+        return;
+    }
+
+    for (size_t i = 0; i < list.count; i++) {
+        set_face(chunk->first_index[level] / 6 + i, list.quads[i]);
+    }
+
+    free(list.quads);
+}
+
+// Copies faces first_face to first_face + count - 1 from the staging area
+// to the world buffers
+void upload_staging(size_t first_face, size_t count) {
+    size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    glBindBuffer(GL_ARRAY_BUFFER, world_vertex_buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, first_face * 4 * sizeof(BlockVertex), count * 4 * sizeof(BlockVertex), vertices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, world_index_buffer);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, first_face * 6 * index_size, count * 6 * index_size, indices);
+}
+
+// Emits the merged faces of the world followed by the sun. The chunks are
+// merged once in parallel to count their quads and placed one after another
+// in the buffers, which are then created at their exact size. Batches of
+// chunks that fit the staging area are merged again, written in parallel
+// and uploaded. With instanced rendering only the sun is meshed.
+void mesh_world() {
+    size_t quad_count = 0;
+    size_t visible = 0;
+    size_t staging_faces = STAGING_FACES;
+
+    chunks_x = (world.size_x + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    num_chunks = (size_t) chunks_x * ((world.size_z + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    chunks = (WorldChunk *) calloc(num_chunks, sizeof(WorldChunk));
+
+    seen_chunks = (size_t *) malloc(sizeof(size_t) * num_chunks);
+    chunk_seen_frame = (unsigned *) calloc(num_chunks, sizeof(unsigned));
+
+    if (chunks == NULL || seen_chunks == NULL || chunk_seen_frame == NULL) {
+        printf("\nNot enough memory for %zu chunks! Exiting...\n", num_chunks);
+        exit(1);
+    }
+
+    if (instanced_rendering) {
+        collect_block_instances();
+    } else {
+        int failed = 0;
+
+        run_jobs(count_chunk_job, &failed, num_chunks);
+
+        if (failed) {
+            printf("\nNot enough memory to mesh the world! Exiting...\n");
+            exit(1);
+        }
+    }
+
+    // Instanced blocks are not meshed, only the suns are
+    size_t parts = instanced_rendering ? 0 : num_chunks * LOD_LEVELS;
+    size_t level_quads[LOD_LEVELS] = { 0 };
+
+    for (size_t part = 0; part < parts; part++) {
+        int level;
+        WorldChunk *chunk = chunk_part(part, &level);
+        size_t faces = chunk->index_count[level] / 6;
+
+        chunk->first_index[level] = quad_count * 6;
+        quad_count += faces;
+        level_quads[level] += faces;
+
+        if (level == 0) {
+            visible += chunk->visible;
+        }
+
+        // Every part has to fit in one batch
+        if (faces > staging_faces) {
+            staging_faces = faces;
+        }
+    }
+
+    num_vertices = (quad_count + 12) * 4; // Two whole cubes for the suns
+    num_indices = (quad_count + 12) * 6;
+
+    // Small worlds get 16-bit indices
+    index_type = num_vertices <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    vertices = (BlockVertex *) malloc(sizeof(BlockVertex) * staging_faces * 4);
+    indices = (GLuint *) malloc(sizeof(GLuint) * staging_faces * 6);
+
+    if (vertices == NULL || indices == NULL) {
+        printf("\nNot enough memory to mesh the world! Exiting...\n");
+        exit(1);
+    }
+
+    glGenBuffers(1, &world_vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, world_vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BlockVertex) * num_vertices, NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &world_index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, world_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_size * num_indices, NULL, GL_STATIC_DRAW);
+
+    StagingBatch batch = { 0, 0 };
+    int level;
+
+    while (batch.first_part < parts) {
+        size_t end = batch.first_part;
+        size_t faces = 0;
+        WorldChunk *chunk;
+
+        while (end < parts && faces + (chunk = chunk_part(end, &level))->index_count[level] / 6 <= staging_faces) {
+            faces += chunk->index_count[level] / 6;
+            end++;
+        }
+
+        chunk = chunk_part(batch.first_part, &level);
+        staging_first_face = chunk->first_index[level] / 6;
+        run_jobs(write_chunk_job, &batch, end - batch.first_part);
+
+        if (batch.failed) {
+            printf("\nNot enough memory to mesh the world! Exiting...\n");
+            exit(1);
+        }
+
+        upload_staging(staging_first_face, faces);
+        batch.first_part = end;
+    }
+
+    face_index = quad_count;
+    staging_first_face = quad_count;
+
+    // Generate the sun
+    set_block_faces((left + right) / 2, WALL_HEIGHT + 20, (bottom + top) / 2, block_types[BLOCK_BIRCH_PLANKS], 0x3f);
+    light_position = (vec4) { (left + right) / 2, WALL_HEIGHT + 1, (bottom + top) / 2, 1.0 };
+
+    // Decoy sun
+    set_block_faces((left + right) / 2, WALL_HEIGHT + 20, (bottom + top) / 2, block_types[BLOCK_BIRCH_PLANKS], 0x3f);
+
+    upload_staging(quad_count, 12);
+
+    free(vertices);
+    free(indices);
+    vertices = NULL;
+    indices = NULL;
+
+    if (!instanced_rendering) {
+        printf("World: %zu visible block faces merged into %zu quads in %zu chunks", visible, level_quads[0],
+            num_chunks);
+
+        for (int level = 1; level < LOD_LEVELS; level++) {
+            printf(", %zu quads of %d^3 cubes", level_quads[level], 1 << level);
+        }
+
+        printf(", %zu vertices, %zu indices, %zu faces staged at a time\n", num_vertices, num_indices, staging_faces);
+    }
+}
+
+typedef struct {
+    int x_min, x_max;
+    int z_min, z_max;
+} IslandBounds;
+
+// Distance from a column of the island to its nearest side
+int island_distance(IslandBounds *island, int x, int z) {
+    int min_distance = x - island->x_min + 1;
+
+    if (island->x_max - x < min_distance) {
+        min_distance = island->x_max - x;
+    }
+
+    if (z - island->z_min + 1 < min_distance) {
+        min_distance = z - island->z_min + 1;
+    }
+
+    if (island->z_max - z < min_distance) {
+        min_distance = island->z_max - z;
+    }
+
+    return min_distance;
+}
+
+// Block of the wall standing on column (x, z) of the maze, BLOCK_AIR where
+// there is none. Posts stand at the corners of every cell and walls fill
+// the sides between them.
+int maze_wall_block(int x, int z) {
+    int cell_x = x / CELL_SIZE_WITH_WALLS;
+    int cell_z = z / CELL_SIZE_WITH_WALLS;
+    int on_x = x % CELL_SIZE_WITH_WALLS == 0;
+    int on_z = z % CELL_SIZE_WITH_WALLS == 0;
+    int wall;
+
+    if (on_x && on_z) {
+        return BLOCK_STONE_BRICKS;
+    } else if (on_z) {
+        wall = cell_z < maze_height ? maze_top(maze, cell_x, cell_z) : maze_bottom(maze, cell_x, maze_height - 1);
+    } else if (on_x) {
+        wall = cell_x < maze_width ? maze_left(maze, cell_x, cell_z) : maze_right(maze, maze_width - 1, cell_z);
+    } else {
+        wall = 0;
+    }
+
+    return wall ? BLOCK_BRICKS : BLOCK_AIR;
+}
+
+// Places the island, maze base and walls on the columns of one column of
+// sections. Every column draws from its own random streams and only this
+// job writes to these sections, so the jobs can run on any thread.
+void section_column_job(void *context, size_t job) {
+    IslandBounds *island = context;
+    int x_min = world.min_x + job % world.sections_x * SECTION_SIZE;
+    int z_min = world.min_z + job / world.sections_x * SECTION_SIZE;
+    int x_max = x_min + SECTION_SIZE < world.min_x + world.size_x ? x_min + SECTION_SIZE : world.min_x + world.size_x;
+    int z_max = z_min + SECTION_SIZE < world.min_z + world.size_z ? z_min + SECTION_SIZE : world.min_z + world.size_z;
+    int maze_x_size = maze_width * CELL_SIZE_WITH_WALLS + 1;
+    int maze_z_size = maze_height * CELL_SIZE_WITH_WALLS + 1;
+
+    for (int x = x_min; x < x_max; x++) {
+        for (int z = z_min; z < z_max; z++) {
+            // Island columns are placed up to island_z_max on x too
+            if (x < island->z_max) {
+                generate_island_column(x, z, island_distance(island, x, z));
+            }
+
+            if (x < 0 || x >= maze_x_size || z < 0 || z >= maze_z_size) {
+                continue;
+            }
+
+            set_block(x, 1, z, BLOCK_BIRCH_PLANKS);
+
+            int wall = maze_wall_block(x, z);
+
+            if (wall != BLOCK_AIR) {
+                generate_maze_wall(x, z, wall);
+            }
+        }
+    }
+}
+
 void generate_world() {
     // Calculate max number of vertices without missing blocks
     int maze_x_size = maze_width * CELL_SIZE_WITH_WALLS + 1;
@@ -465,19 +1067,6 @@ void generate_world() {
         max_side = island_larger_side;
     }
 
-    size_t maze_floor_blocks = maze_x_size * maze_z_size;
-    size_t maze_walls_blocks = ((maze_height + 1) * (maze_width + 1) + (maze_height * (maze_width + 1) + maze_width * (maze_height + 1) - maze_width * maze_height - 1) * CELL_SIZE) * WALL_HEIGHT;
-    size_t island_blocks = total_x_size * total_z_size * (REMOVE_DIST + 1);
-
-    int long_length = island_larger_side;
-
-    for (int short_length = island_smaller_side; short_length > 0; short_length -= 2) {
-        island_blocks += long_length * short_length;
-        long_length -= 2;
-    }
-
-    num_vertices = (maze_floor_blocks + maze_walls_blocks + island_blocks + 1) * 36;
-
     // Store bounds
     left = -ISLAND_PADDING;
     right = total_x_size - ISLAND_PADDING - 1;
@@ -498,321 +1087,327 @@ void generate_world() {
     printf("Bottom: %d Top: %d\n", bottom, top);
     printf("Near: %d Far: %d\n", near, far);
 
-    // Allocate arrays
-    positions = (vec4 *) malloc(sizeof(vec4) * num_vertices);
-    normals = (vec4 *) malloc(sizeof(vec4) * num_vertices);
-    tex_coords = (vec2 *) malloc(sizeof(vec2) * num_vertices);
-
     // Generate island
     int island_x_min = -ISLAND_PADDING;
     int island_x_max = maze_x_size + ISLAND_PADDING;
     int island_z_min = -ISLAND_PADDING;
     int island_z_max = maze_z_size + ISLAND_PADDING;
 
-    for (int x = island_x_min; x < island_z_max; x++) {
-        // Calculate minimum distance from any side
-        int dist_from_left = x - island_x_min + 1;
-        int dist_from_right = island_x_max - x;
-        int min_dist_x;
+    // Island columns are placed up to island_z_max on x too
+    int world_x_max = (island_x_max > island_z_max ? island_x_max : island_z_max) - 1;
 
-        if (dist_from_left < dist_from_right) {
-            min_dist_x = dist_from_left;
-        } else {
-            min_dist_x = dist_from_right;
-        }
+    // Vertex positions are 16-bit
+    if (world_x_max >= SHRT_MAX || island_z_max >= SHRT_MAX || island_height + REMOVE_DIST >= SHRT_MAX) {
+        printf("\nThe world is too large to draw! Exiting...\n");
+        exit(1);
+    }
 
-        for (int z = island_z_min; z < island_z_max; z++) {
-            int min_distance = min_dist_x;
-            int dist_from_bottom = island_z_max - z;
-            int dist_from_top = z - island_z_min + 1;
+    if (!world_create(&world, island_x_min, -REMOVE_DIST - island_height, island_z_min, world_x_max, 1 + WALL_HEIGHT,
+                      island_z_max - 1)) {
+        printf("\nNot enough memory for the world! Exiting...\n");
+        exit(1);
+    }
 
-            if (dist_from_top < min_distance) {
-                min_distance = dist_from_top;
-            }
+    IslandBounds island = { island_x_min, island_x_max, island_z_min, island_z_max };
+    run_jobs(section_column_job, &island, (size_t) world.sections_x * world.sections_z);
 
-            if (dist_from_bottom < min_distance) {
-                min_distance = dist_from_bottom;
-            }
+    printf("World: %zu blocks stored in %zu KB, %.2f bits per block\n",
+        (size_t) world.size_x * world.size_y * world.size_z, world_memory(&world) / 1024,
+        world_memory(&world) * 8.0 / ((double) world.size_x * world.size_y * world.size_z));
 
-            generate_island_column(x, z, min_distance);
-        }
+    mesh_world();
+}
+
+void prompt_maze_size() {
+    // Size already given on the command line
+    if (maze_width > 0 && maze_height > 0) {
+        return;
     }
 
-    // Generate maze base
-    for (int x = 0; x < maze_x_size; x++) {
-        for (int z = 0; z < maze_z_size; z++) {
-            set_block(x, 1, z, BLOCK_BIRCH_PLANKS);
-        }
+    // Ask for input
+    printf("Enter width and the height for the size of the maze (ex. 6 8)\n");
+
+    if(scanf("%d %d", &maze_width, &maze_height) <= 0 || maze_width <= 0 || maze_height <= 0)
+    {
+        printf("\nInvalid Input! Exiting...\n");
+        exit(1);
+    }
+}
+
+void create_maze() {
+    maze = maze_create(maze_width, maze_height);
+
+    if (maze == NULL) {
+        printf("\nNot enough memory for a %d x %d maze! Exiting...\n", maze_width, maze_height);
+        exit(1);
+    }
+
+    if (generator == GENERATOR_ELLER) {
+        generate_maze_eller(maze, seed);
+    } else {
+        generate_maze(maze, seed, thread_count);
     }
+}
 
-    // Generate maze
-    int right_pos = maze_x_size - 1;
-    int bottom_pos = maze_z_size - 1;
+void load_maze() {
+    MazeFileHeader header;
+    maze = maze_map(load_path, &header, verify_load);
 
-    // For each row
-    for (int y = 0; y < maze_height; y++) {
-        int z_pos = y * CELL_SIZE_WITH_WALLS;
+    if (maze == NULL) {
+        exit(1);
+    }
 
-        Cell cell;
+    // The island is rebuilt from the seed the maze was generated with
+    maze_width = maze->width;
+    maze_height = maze->height;
+    seed = header.seed;
+    generator = header.generator;
+}
 
-        // Top wall
-        for (int x = 0; x < maze_width; x++) {
-            cell = maze[x][y];
-            int x_pos = x * CELL_SIZE_WITH_WALLS;
+FILE *open_output(const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
 
-            generate_maze_wall(x_pos, z_pos, BLOCK_STONE_BRICKS);
+    if (file == NULL) {
+        printf("\nCould not open %s for writing\n", path);
+        exit(1);
+    }
 
-            // Top wall
-            if (cell.top) {   
-                for (int i = 1; i <= CELL_SIZE; i++) {
-                    generate_maze_wall(x_pos + i, z_pos, BLOCK_BRICKS);
-                }
-            }
+    return file;
+}
 
-            // Left wall
-            if (cell.left) {
-                for (int i = 1; i <= CELL_SIZE; i++) {
-                    generate_maze_wall(x_pos, z_pos + i, BLOCK_BRICKS);
-                }
-            }
-        }
+int close_output(FILE *file) {
+    return file == stdout || fclose(file) == 0;
+}
 
-        // Right of row
-        generate_maze_wall(right_pos, z_pos, BLOCK_STONE_BRICKS);
+// Solves random pairs of cells in one batch and reports the throughput
+int run_queries() {
+    PathQuery *queries = malloc(query_count * sizeof(PathQuery));
+    MazeGraph graph;
+    PathBatch batch;
+    Rng rng;
 
-        if (cell.right) {
-            for (int i = 1; i <= CELL_SIZE; i++) {
-                generate_maze_wall(right_pos, z_pos + i, BLOCK_BRICKS);
-            }
-        }
+    if (queries == NULL || !build_maze_graph(maze, &graph)) {
+        printf("\nNot enough memory to solve queries\n");
+        free(queries);
+        return 1;
     }
 
-    // Bottom of maze
-    for (int x = 0; x < maze_width; x++) {
-        Cell cell = maze[x][maze_height - 1];
-        int x_pos = x * CELL_SIZE_WITH_WALLS;
+    rng_init_stream(&rng, seed, STREAM_QUERY);
 
-        generate_maze_wall(x_pos, bottom_pos, BLOCK_STONE_BRICKS);
-    
-        if (cell.bottom) {
-            for (int i = 1; i <= CELL_SIZE; i++) {
-                generate_maze_wall(x_pos + i, bottom_pos, BLOCK_BRICKS);
-            }
-        }
+    for (size_t i = 0; i < query_count; i++) {
+        queries[i].start_x = rng_below(&rng, maze_width);
+        queries[i].start_y = rng_below(&rng, maze_height);
+        queries[i].goal_x = rng_below(&rng, maze_width);
+        queries[i].goal_y = rng_below(&rng, maze_height);
     }
 
-    // Bottom right corner
-    generate_maze_wall(right_pos, bottom_pos, BLOCK_STONE_BRICKS);
+    if (!solve_path_batch(&graph, queries, query_count, thread_count, &batch)) {
+        printf("\nNot enough memory to solve queries\n");
+        maze_graph_free(&graph);
+        free(queries);
+        return 1;
+    }
 
-    // Generate the sun
-    set_block((left + right) / 2, WALL_HEIGHT + 20, (bottom + top) / 2, BLOCK_BIRCH_PLANKS);
-    light_position = (vec4) { (left + right) / 2, WALL_HEIGHT + 1, (bottom + top) / 2, 1.0 };
+    printf("Solved %zu of %zu queries on %d threads in %.3f s: %.0f queries/s, %zu path cells, %zu nodes searched\n",
+        batch.solved, batch.count, batch.threads, batch.seconds, batch.count / batch.seconds, batch.offsets[batch.count],
+        batch.expanded);
 
-    // Decoy sun
-    set_block((left + right) / 2, WALL_HEIGHT + 20, (bottom + top) / 2, BLOCK_BIRCH_PLANKS);
+    path_batch_free(&batch);
+    maze_graph_free(&graph);
+    free(queries);
+    return 0;
+}
+
+// Times one search from the entrance to the exit
+int run_solve() {
+    const char *names[] = { "BFS", "A*", "Bitset BFS" };
+    long started = get_micro_time();
+
+    if (!solve_maze(maze, 0, 0, maze_width - 1, maze_height - 1, solve_method, &path)) {
+        printf("\nNo path to the exit, or not enough memory to search\n");
+        return 1;
+    }
+
+    printf("%s: %zu cells to the exit, %zu cells searched in %.3f ms, %zu bytes of search memory\n",
+        names[solve_method], path.length, path.expanded, (get_micro_time() - started) / 1000.0, search_arena.peak);
 
-    // Set actual number of vertices
-    num_vertices = vertex_index;
+    maze_path_free(&path);
+    arena_free(&path_arena);
+    return 0;
 }
 
-void prompt_maze_size() {
-    // Ask for input and generate maze
-    printf("Enter width and the height for the size of the maze (ex. 6 8)\n");
+int validate_to_file() {
+    MazeReport report;
 
-    if(scanf("%d %d", &maze_width, &maze_height) > 0 && maze_width > 0 && maze_height > 0)
-    {
-        maze = malloc(maze_width * sizeof(Cell *));
+    if (!validate_maze(maze, thread_count, &report)) {
+        printf("\nNot enough memory to validate the maze\n");
+        return 1;
+    }
 
-        for (int i = 0; i < maze_width; i++) {
-            maze[i] = malloc(maze_height * sizeof(Cell));
-        }
+    report.seed = seed;
+    report.generator = generator;
+
+    FILE *file = open_output(validate_path);
+    write_report_json(file, &report);
 
-        printf("Width: %d Height: %d\n", maze_width, maze_height);
-        generate_maze(maze, maze_width, maze_height);
-        print_maze(maze, maze_width, maze_height);
+    if (!close_output(file)) {
+        printf("\nFailed to write %s\n", validate_path);
+        return 1;
     }
-    else
-    {
-        printf("\nInvalid Input! Exiting...\n");
-        exit(1);
+
+    return report.perfect ? 0 : 2;
+}
+
+#define MAX_EXPORTS 4
+
+// Every output the maze is written to, fed the same rows
+typedef struct {
+    int count;
+    MazeRowFunc write_row[MAX_EXPORTS];
+    void *writer[MAX_EXPORTS];
+} ExportTargets;
+
+int export_row(const MazeRow *row, void *context) {
+    ExportTargets *targets = context;
+
+    for (int i = 0; i < targets->count; i++) {
+        if (!targets->write_row[i](row, targets->writer[i])) {
+            return 0;
+        }
     }
+
+    return 1;
 }
 
-//0 is top
-//1 is left
-//2 is bottom
-//3 is right    
-int dfs_recursive(Cell loc, int loc_x, int loc_y, int dir) {
-    
-    struct Coordinate *nextCoor = (struct Coordinate *) malloc(sizeof(Coordinate));
-    nextCoor->x = loc_x;
-    nextCoor->y = loc_y;
-    if(loc_x == 0 && loc_y == 0) {
-        path = nextCoor;
-        current_step = path;
-    }
-    else {
-        current_step->next = nextCoor;
-        current_step = current_step->next;
-    }
-    printf(" t(%d,%d)\n", current_step->x, current_step->y);
-    // current = curr;
-    if(loc_x == maze_width-1 && loc_y == maze_height-1) {
-        current_step->next = NULL;
-        printf("Found exit");
-        return 1;
+void add_export(ExportTargets *targets, MazeRowFunc write_row, void *writer) {
+    targets->write_row[targets->count] = write_row;
+    targets->writer[targets->count] = writer;
+    targets->count++;
+}
+
+// Writes the maze without opening a window. Eller's generator streams
+// rows straight to the outputs, so memory stays proportional to the width.
+int export_maze() {
+    ExportTargets targets = { 0 };
+    AsciiWriter ascii;
+    ImageWriter pbm;
+    ImageWriter pgm;
+    MazeWriter writer;
+    int ascii_open = 0;
+    int pbm_open = 0;
+    int pgm_open = 0;
+    int save_open = 0;
+    int opened = 0;
+    int ok = 1;
+
+    if (load_path != NULL) {
+        load_maze();
+    } else {
+        prompt_maze_size();
     }
-    // if(dir == 0 && loc.left == 1 && loc.right == 1 && loc.bottom == 1) {
-    //     printf("Dead end 1");
-    //     return 0;
-    // }
-    // if(dir == 1 && loc.top == 1 && loc.right == 1 && loc.bottom == 1) {
-    //     printf("Dead end 2");
-    //     return 0;
-    // }
-    // if(dir == 2 && loc.left == 1 && loc.right == 1 && loc.top == 1) {
-    //     printf("Dead end 3");
-    //     return 0;
-    // }
-    // if(dir == 3 && loc.left == 1 && loc.top == 1 && loc.bottom == 1) {
-    //     printf("Dead end 4");
-    //     return 0;
-    // }
-
-    int found = 0;
-    if(loc_y > 0 && loc.top == 0 && dir != 2) {
-        printf("Move top");
-        printf("(%d,%d)\n", current_step->x, current_step->y);
-        found = dfs_recursive(maze[loc_x][loc_y-1], loc_x, loc_y-1, 0);
-        printf(" (%d,%d)\n", current_step->x, current_step->y);
-    }
-    if(found != 1 && loc_y < maze_height-1 && loc.bottom == 0 && dir != 0) {
-        printf("Move bottom");
-        printf("x=%d, y=%d\n", loc_x, loc_y);
-        if(current_step->x != loc_x || current_step->y != loc_y) {
-            struct Coordinate *copy = (struct Coordinate *) malloc(sizeof(Coordinate));
-            copy->x = loc_x;
-            copy->y = loc_y;
-            current_step->next = copy;
-            current_step = current_step->next;
-            printf("(%d,%d)\n", current_step->x, current_step->y);
+
+    // A writer that fails to open still holds its file, so it is closed too
+    if (ascii_path != NULL) {
+        ascii_open = 1;
+
+        if (!ascii_writer_open(&ascii, open_output(ascii_path), maze_width)) {
+            printf("\nNot enough memory to export the maze\n");
+            goto close;
         }
-        found = dfs_recursive(maze[loc_x][loc_y+1], loc_x, loc_y+1, 2);
-        printf(" (%d,%d)\n", current_step->x, current_step->y);
-    }
-    if(found != 1 && loc_x > 0 && loc.left == 0 && dir != 3) {
-        printf("Move left");
-        printf("x=%d, y=%d\n", loc_x, loc_y);
-        if(current_step->x != loc_x || current_step->y != loc_y) {
-            struct Coordinate *copy = (struct Coordinate *) malloc(sizeof(Coordinate));
-            copy->x = loc_x;
-            copy->y = loc_y;
-            current_step->next = copy;
-            current_step = current_step->next;
-            printf(" (%d,%d)\n", current_step->x, current_step->y);
+
+        add_export(&targets, write_ascii_row, &ascii);
+    }
+
+    if (pbm_path != NULL) {
+        pbm_open = 1;
+
+        if (!image_writer_open(&pbm, open_output(pbm_path), IMAGE_PBM, maze_width, maze_height)) {
+            printf("\nNot enough memory to export the maze\n");
+            goto close;
         }
-        found = dfs_recursive(maze[loc_x-1][loc_y], loc_x-1, loc_y, 1);
-        printf("(%d,%d)\n", current_step->x, current_step->y);
-    }
-    if(found != 1 && loc_x < maze_width-1 && loc.right == 0 && dir != 1) {
-        printf("Move right");
-        printf("x=%d, y=%d\n", loc_x, loc_y);
-        if(current_step->x != loc_x || current_step->y != loc_y) {
-            struct Coordinate *copy = (struct Coordinate *) malloc(sizeof(Coordinate));
-            copy->x = loc_x;
-            copy->y = loc_y;
-            current_step->next = copy;
-            current_step = current_step->next;
-            printf(" (%d,%d)\n", current_step->x, current_step->y);
+
+        add_export(&targets, write_image_row, &pbm);
+    }
+
+    if (pgm_path != NULL) {
+        pgm_open = 1;
+
+        if (!image_writer_open(&pgm, open_output(pgm_path), IMAGE_PGM, maze_width, maze_height)) {
+            printf("\nNot enough memory to export the maze\n");
+            goto close;
         }
-        found = dfs_recursive(maze[loc_x+1][loc_y], loc_x+1, loc_y, 3);
-        printf("(%d,%d)\n", current_step->x, current_step->y);
+
+        add_export(&targets, write_image_row, &pgm);
     }
-    printf("x=%d, y=%d\n", loc_x, loc_y);
-    if(found != 1 && (current_step->x != loc_x || current_step->y != loc_y)) {
-        struct Coordinate *currCoor = (struct Coordinate *) malloc(sizeof(Coordinate));
-        currCoor->x = loc_x;
-        currCoor->y = loc_y;
-        current_step->next = currCoor;
-        current_step = current_step->next;
-        printf("c(%d,%d)\n", current_step->x, current_step->y);
+
+    if (save_path != NULL) {
+        if (!maze_writer_open(&writer, save_path, maze_width, maze_height, seed, generator)) {
+            printf("\nCould not open %s for writing\n", save_path);
+            goto close;
+        }
+
+        save_open = 1;
+        add_export(&targets, write_maze_row, &writer);
     }
 
-    return found;
+    opened = 1;
 
+    // Validation and solves need the whole maze, otherwise it is never stored
+    if (maze == NULL && generator == GENERATOR_ELLER && validate_path == NULL && query_count == 0 &&
+        solve_method < 0) {
+        ok = generate_maze_rows(maze_width, maze_height, seed, export_row, &targets);
+    } else {
+        if (maze == NULL) {
+            create_maze();
+        }
 
+        ok = for_each_maze_row(maze, export_row, &targets);
+    }
 
-}
+close:
+    // Each file is closed even when its writer or an earlier output failed
+    if (ascii_open) {
+        ok = ascii_writer_close(&ascii) && ok;
+        ok = close_output(ascii.output.file) && ok;
+    }
 
-void dfs() {
-    Cell start = maze[0][0];
-    int found = dfs_recursive(start, 0, 0, 3);
-}
+    if (pbm_open) {
+        ok = image_writer_close(&pbm) && ok;
+        ok = close_output(pbm.output.file) && ok;
+    }
 
-int dfs_anyposition_recursive(Cell loc, int loc_x, int loc_y, int dir, Coordinate *curr) {
-    struct Coordinate *nextCoor = (struct Coordinate *) malloc(sizeof(Coordinate));
-    nextCoor->x = loc_x;
-    nextCoor->y = loc_y;
-    curr->next = nextCoor;
-    //printf(" t(%d,%d)\n", curr->x, curr->y);
-    // current = curr;
-    if(loc_x == maze_width-1 && loc_y == maze_height-1) {
-        printf("Found exit\n");
-        curr->next->next = NULL;
-        return 1;
+    if (pgm_open) {
+        ok = image_writer_close(&pgm) && ok;
+        ok = close_output(pgm.output.file) && ok;
     }
 
-    int found = 0;
-    if(loc_y > 0 && loc.top == 0 && dir != 2) {
-        printf("Move top\n");
-        found = dfs_anyposition_recursive(maze[loc_x][loc_y-1], loc_x, loc_y-1, 0, curr->next);
-        //printf(" (%d,%d)\n", current->x, current->y);
+    if (save_open) {
+        ok = maze_writer_close(&writer) && ok;
     }
-    if(found != 1 && loc_y < maze_height-1 && loc.bottom == 0 && dir != 0) {
-        printf("Move bottom\n");
-        found = dfs_anyposition_recursive(maze[loc_x][loc_y+1], loc_x, loc_y+1, 2, curr->next);
-        //printf(" (%d,%d)\n", current->x, current->y);
+
+    if (!opened) {
+        return 1;
     }
-    if(found != 1 && loc_x > 0 && loc.left == 0 && dir != 3) {
-        printf("Move left\n");
-        found = dfs_anyposition_recursive(maze[loc_x-1][loc_y], loc_x-1, loc_y, 1, curr->next);
-        //printf("(%d,%d)\n", current->x, current->y);
+
+    if (!ok) {
+        printf("\nFailed to export the maze\n");
+        return 1;
     }
-    if(found != 1 && loc_x < maze_width-1 && loc.right == 0 && dir != 1) {
-        printf("Move right\n");
-        found = dfs_anyposition_recursive(maze[loc_x+1][loc_y], loc_x+1, loc_y, 3, curr->next);
-        //printf("(%d,%d)\n", curr->x, curr->y);
+
+    if (query_count > 0 && run_queries() != 0) {
+        return 1;
     }
-    return found;
-}
 
-void dfs_anyposition() {
-    Cell start = maze[maze_x][maze_y];
-    path = (struct Coordinate *) malloc(sizeof(Coordinate));
-    path->x = maze_x;
-    path->y = maze_y;
-    int found = dfs_anyposition_recursive(start, maze_x, maze_y, -1, path);
-    path = path->next;
-}
+    if (solve_method >= 0 && run_solve() != 0) {
+        return 1;
+    }
 
-void print_list() {
-    //printf("Entering print");
-    current_step = path;
-    //printf("(%d,%d), ", list->x, list->y);
-    while (current_step->x != maze_width-1 || current_step->y != maze_height-1) {
-        printf("(%d,%d), ", current_step->x, current_step->y);
-        current_step = current_step->next;
+    if (validate_path != NULL) {
+        return validate_to_file();
     }
-    printf("(%d,%d) ", current_step->x, current_step->y);
-    printf("\n");
-}
 
-// Coordinate* coor_copy(Coordinate *original) {
-//     struct Coordinate *copy = (struct Coordinate *) malloc(sizeof(Coordinate));
-//     copy->x = original->x;
-//     copy->y = original->y;
-//     return copy;
-// }
+    return 0;
+}
 
 // Print out all keyboard keys that are used to the console
 void print_helper_text()
@@ -831,6 +1426,7 @@ void print_helper_text()
 
     printf("P - Solve From Entrance\n");
     printf("I - Solve From Anywhere\n");
+    printf("F - Toggle Fast Navigation\n");
 
     printf("\n---------[Camera]---------\n");
     printf("R - Reset to Side View\n");
@@ -878,13 +1474,18 @@ void update_positions(vec4 position, int facing) {
     }
 }
 
-void start_animation() {
+void start_timed_animation(long duration) {
     animation_started = get_micro_time();
+    animation_duration = duration;
     eye_move_vector = sub_v4(target_pos.eye, current_pos.eye);
     at_move_vector = sub_v4(target_pos.at, current_pos.at);
     is_animating = 1;
 }
 
+void start_animation() {
+    start_timed_animation(ANIMATION_DURATION);
+}
+
 void move_to(vec4 position) {
     update_positions(position, player_facing);
     start_animation();
@@ -918,8 +1519,8 @@ void move_direction(int direction) {
         case 0:
             // Pos x
             if (maze_y >= 0 && maze_y < maze_height &&
-                (maze_x == -1 && maze[0][maze_y].left ||
-                maze_x >= 0 && maze_x < maze_width && maze[maze_x][maze_y].right)) {
+                (maze_x == -1 && maze_left(maze, 0, maze_y) ||
+                maze_x >= 0 && maze_x < maze_width && maze_right(maze, maze_x, maze_y))) {
                 return; // Collision
             }
 
@@ -928,8 +1529,8 @@ void move_direction(int direction) {
         case 1:
             // Pos y
             if (maze_x >= 0 && maze_x < maze_width &&
-                (maze_y == -1 && maze[maze_x][0].top ||
-                maze_y >= 0 && maze_y < maze_height && maze[maze_x][maze_y].bottom)) {
+                (maze_y == -1 && maze_top(maze, maze_x, 0) ||
+                maze_y >= 0 && maze_y < maze_height && maze_bottom(maze, maze_x, maze_y))) {
                 return; // Collision
             }
 
@@ -938,8 +1539,8 @@ void move_direction(int direction) {
         case 2:
             // Neg x
             if (maze_y >= 0 && maze_y < maze_height &&
-                (maze_x == maze_width && maze[maze_width - 1][maze_y].right ||
-                maze_x >= 0 && maze_x < maze_width && maze[maze_x][maze_y].left)) {
+                (maze_x == maze_width && maze_right(maze, maze_width - 1, maze_y) ||
+                maze_x >= 0 && maze_x < maze_width && maze_left(maze, maze_x, maze_y))) {
                 return; // Collision
             }
 
@@ -948,8 +1549,8 @@ void move_direction(int direction) {
         case 3:
             // Neg y
             if (maze_x >= 0 && maze_x < maze_width &&
-                (maze_y == maze_height && maze[maze_x][maze_height - 1].bottom ||
-                maze_y >= 0 && maze_y < maze_height && maze[maze_x][maze_y].top)) {
+                (maze_y == maze_height && maze_bottom(maze, maze_x, maze_height - 1) ||
+                maze_y >= 0 && maze_y < maze_height && maze_top(maze, maze_x, maze_y))) {
                 return; // Collision
             }
             
@@ -968,36 +1569,46 @@ void turn(int direction) {
 }
 
 void do_maze_step() {
-    if (current_step == NULL) {
+    if (path.cells == NULL) {
         return;
     }
+
+    int fast = path_fast;
+    long duration = fast ? MICROSECONDS_PER_SECOND / navigation_speed : ANIMATION_DURATION;
     
     // Turn to exit if at end
-    if (current_step->next == NULL) {
+    if (path_step + 1 >= path.length) {
         if (player_facing != 0) {
             turn_to(0);
-            start_animation();
+            start_timed_animation(duration);
         }
 
-        current_step = NULL;
+        maze_path_free(&path);
         return;
     }
 
-    Coordinate *next = current_step->next;
-
     // Calculate direction
     int new_direction;
-    int dx = next->x - current_step->x;
-    int dy = next->y - current_step->y;
-
-    if (dx == 1) {
-        new_direction = 0;
-    } else if (dy == 1) {
-        new_direction = 1;
-    } else if (dx == -1) {
-        new_direction = 2;
-    } else if (dy == -1) {
-        new_direction = 3;
+    int length = 1;
+
+    if (fast) {
+        new_direction = path.segments[path_segment].direction;
+        length = path.segments[path_segment].length;
+    } else {
+        PathCell current = path.cells[path_step];
+        PathCell next = path.cells[path_step + 1];
+        int dx = next.x - current.x;
+        int dy = next.y - current.y;
+
+        if (dx == 1) {
+            new_direction = 0;
+        } else if (dy == 1) {
+            new_direction = 1;
+        } else if (dx == -1) {
+            new_direction = 2;
+        } else {
+            new_direction = 3;
+        }
     }
     
     // Turn if not facing
@@ -1011,34 +1622,78 @@ void do_maze_step() {
 
             turn(left);
         }
+    } else if (path_step + length < path.length) {
+        // Move, a whole straight run at once when fast
+        PathCell next = path.cells[path_step + length];
+
+        move_to_cell(next.x, next.y);
+        path_step += length;
+        path_segment += fast;
+        duration *= length;
     } else {
-        // Move
-        move_to_cell(next->x, next->y);
-        current_step = next;
+        // A run past the end of the path, stop rather than walk through walls
+        maze_path_free(&path);
+        return;
     }
 
-    start_animation();
+    start_timed_animation(duration);
 }
 
-void free_path() {
-    current_step = path;
+// Builds the junction graph the first time it is needed, solves fall back to
+// it when there is no exit field
+int junction_graph_ready() {
+    if (!junction_graph_tried) {
+        junction_graph_tried = 1;
 
-    while (current_step != NULL) {
-        Coordinate *next = current_step->next;
-        free(current_step);
-        current_step = next;
+        if (build_maze_graph(maze, &junction_graph)) {
+            printf("Junction graph: %zu nodes, %zu edges, %.1f cells per node\n", junction_graph.node_count,
+                junction_graph.edge_count / 2, (double) maze_width * maze_height / junction_graph.node_count);
+        }
     }
+
+    return junction_graph.edges != NULL;
 }
 
-void navigate(void (*path_gen_func)()) {
+void navigate(int method) {
     if (rotation_enabled) {
         return;
     }
 
-    free_path();
-    path_gen_func();
-    print_list();
-    current_step = path;
+    long started = get_micro_time();
+    int found;
+
+    maze_path_free(&path);
+    arena_reset(&path_arena);
+
+    // Search only if there was no memory for the exit field
+    if (exit_field.parent != NULL) {
+        found = follow_direction_field(&exit_field, maze_x, maze_y, &path);
+    } else if (junction_graph_ready()) {
+        found = solve_maze_graph(&junction_graph, maze_x, maze_y, maze_width - 1, maze_height - 1, &path);
+    } else {
+        found = solve_maze(maze, maze_x, maze_y, maze_width - 1, maze_height - 1, method, &path);
+    }
+
+    if (!found) {
+        printf("No path to the exit from (%d, %d)\n", maze_x, maze_y);
+        return;
+    }
+
+    path_fast = fast_navigation && maze_path_segments(&path);
+
+    if (fast_navigation && !path_fast) {
+        printf("Not enough memory for straight runs, walking cell by cell\n");
+    }
+
+    printf("%zu cells to the exit, found in %.3f ms\n", path.length, (get_micro_time() - started) / 1000.0);
+
+    if (path.segments != NULL) {
+        printf("%zu straight runs, about %.1f s to walk\n", path.segment_count,
+            (path.length - 1 + path.segment_count) / navigation_speed);
+    }
+
+    path_step = 0;
+    path_segment = 0;
     do_maze_step();
 }
 
@@ -1130,11 +1785,15 @@ void keyboard(unsigned char key, int mousex, int mousey)
             break;
         case 'p':
             if (maze_x == 0 && maze_y == 0) {
-                navigate(dfs);
+                navigate(SOLVER_BFS);
             }
             break;
         case 'i':
-            navigate(dfs_anyposition);
+            navigate(SOLVER_ASTAR);
+            break;
+        case 'f':
+            fast_navigation ^= 0x1;
+            printf("Fast navigation: %s\n", fast_navigation == 0 ? "OFF" : "ON");
             break;
         case 'b':
             if(lighting_enabled == 1) {
@@ -1305,7 +1964,7 @@ void idle(void)
     long elapsed = get_micro_time() - animation_started;
     
     // Are we at the target yet?
-    if (elapsed >= ANIMATION_DURATION)
+    if (elapsed >= animation_duration)
     {
         current_pos = target_pos;
         model_view = look_at(target_pos.eye, target_pos.at, target_pos.up);
@@ -1314,7 +1973,7 @@ void idle(void)
         is_animating = 0;
         do_maze_step();
     } else {
-        float progress = (float)elapsed / ANIMATION_DURATION;
+        float progress = (float)elapsed / animation_duration;
         
         vec4 eye_delta = mult_v4(eye_move_vector, progress);
         vec4 eye_temp_pos = add_v4(current_pos.eye, eye_delta);
@@ -1328,6 +1987,68 @@ void idle(void)
     glutPostRedisplay();
 }
 
+#ifndef __APPLE__
+// Uploads a unit cube and one record per block. The vertex shader moves
+// the cube to each block and looks up its tiles by block id.
+void init_instances(GLuint program, GLuint vPosition, GLuint vFaceTile) {
+    BlockVertex cube[24];
+    GLubyte cube_indices[36];
+    GLfloat block_tiles[BLOCK_COUNT * 6] = { 0 };
+
+    for (int face = 0; face < 6; face++) {
+        for (int i = 0; i < 4; i++) {
+            const int *corner = FACE_CORNERS[face][i];
+
+            cube[face * 4 + i] = (BlockVertex) { corner[0], corner[1], corner[2], face, 0 };
+        }
+
+        for (int i = 0; i < 6; i++) {
+            cube_indices[face * 6 + i] = face * 4 + FACE_TRIANGLES[i];
+        }
+
+        for (int block = BLOCK_AIR + 1; block < BLOCK_COUNT; block++) {
+            vec2 texture = block_face_texture(block_types[block], face);
+
+            block_tiles[block * 6 + face] = texture.x + texture.y * (int) (1 / TEX_SIZE);
+        }
+    }
+
+    glGenVertexArrays(1, &instance_vao);
+    glBindVertexArray(instance_vao);
+
+    GLuint buffers[3];
+    glGenBuffers(3, buffers);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cube), cube, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(vPosition);
+    glVertexAttribPointer(vPosition, 3, GL_SHORT, GL_FALSE, sizeof(BlockVertex), (GLvoid *) offsetof(BlockVertex, x));
+    glEnableVertexAttribArray(vFaceTile);
+    glVertexAttribPointer(vFaceTile, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(BlockVertex),
+                          (GLvoid *) offsetof(BlockVertex, face));
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(BlockInstance) * num_instances, instances, GL_STATIC_DRAW);
+
+    GLuint vInstance = glGetAttribLocation(program, "vInstance");
+    glEnableVertexAttribArray(vInstance);
+    glVertexAttribPointer(vInstance, 4, GL_INT, GL_FALSE, sizeof(BlockInstance), (GLvoid *) 0);
+    glVertexAttribDivisorARB(vInstance, 1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
+
+    glUniform1fv(glGetUniformLocation(program, "block_tiles"), BLOCK_COUNT * 6, block_tiles);
+    instanced_location = glGetUniformLocation(program, "instanced");
+
+    glBindVertexArray(world_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    free(instances);
+    instances = NULL;
+}
+#endif
+
 void init(void)
 {
     // Set starting location
@@ -1359,22 +2080,15 @@ void init(void)
     glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &param);
 
     // Initialize buffers
-    GLuint vao;
     #ifdef __APPLE__
-    glGenVertexArraysAPPLE(1, &vao);
-    glBindVertexArrayAPPLE(vao);
+    glGenVertexArraysAPPLE(1, &world_vao);
+    glBindVertexArrayAPPLE(world_vao);
     #else
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    glGenVertexArrays(1, &world_vao);
+    glBindVertexArray(world_vao);
     #endif
 
-    GLuint buffer;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vec4) * 2 * num_vertices + sizeof(vec2) * num_vertices, NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vec4) * num_vertices, positions);
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec4) * num_vertices, sizeof(vec4) * num_vertices, normals);
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(vec4) * 2 * num_vertices, sizeof(vec2) * num_vertices, tex_coords);
+    glBindBuffer(GL_ARRAY_BUFFER, world_vertex_buffer);
 
     // Initialize program
     GLuint program = initShader("vshader.glsl", "fshader.glsl");
@@ -1382,15 +2096,20 @@ void init(void)
 
     GLuint vPosition = glGetAttribLocation(program, "vPosition");
     glEnableVertexAttribArray(vPosition);
-    glVertexAttribPointer(vPosition, 4, GL_FLOAT, GL_FALSE, 0, (GLvoid *) (0));
+    glVertexAttribPointer(vPosition, 3, GL_SHORT, GL_FALSE, sizeof(BlockVertex), (GLvoid *) offsetof(BlockVertex, x));
 
-    GLuint vNormal = glGetAttribLocation(program, "vNormal");
-    glEnableVertexAttribArray(vNormal);
-    glVertexAttribPointer(vNormal, 4, GL_FLOAT, GL_FALSE, 0, (GLvoid *) (sizeof(vec4) * num_vertices));
-    
-    GLuint vTexCoord = glGetAttribLocation(program, "vTexCoord");
-    glEnableVertexAttribArray(vTexCoord);
-    glVertexAttribPointer(vTexCoord, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid *) (sizeof(vec4) * 2 * num_vertices));
+    GLuint vFaceTile = glGetAttribLocation(program, "vFaceTile");
+    glEnableVertexAttribArray(vFaceTile);
+    glVertexAttribPointer(vFaceTile, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(BlockVertex),
+                          (GLvoid *) offsetof(BlockVertex, face));
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, world_index_buffer);
+
+    #ifndef __APPLE__
+    if (instanced_rendering) {
+        init_instances(program, vPosition, vFaceTile);
+    }
+    #endif
 
     current_transformation_matrix = glGetUniformLocation(program, "ctm");
     model_view_location = glGetUniformLocation(program, "model_view");
@@ -1400,6 +2119,9 @@ void init(void)
     GLuint texture_location = glGetUniformLocation(program, "texture");
     glUniform1i(texture_location, 0);
 
+    GLuint tex_size_location = glGetUniformLocation(program, "tex_size");
+    glUniform1f(tex_size_location, TEX_SIZE);
+
     light_enabled_location = glGetUniformLocation(program, "lighting_enabled");
     glUniform1i(light_enabled_location, lighting_enabled);
 
@@ -1421,6 +2143,409 @@ void init(void)
     glDepthRange(1,0);
 }
 
+// Planes of the view frustum taken from the rows of the clip matrix, a
+// point is inside when dot(plane, point) >= 0 for all of them. There is no
+// far plane, it is beyond anything in the world.
+void frustum_planes(mat4 clip, vec4 planes[5]) {
+    vec4 x = get_row(clip, 0);
+    vec4 y = get_row(clip, 1);
+    vec4 w = get_row(clip, 3);
+
+    planes[0] = add_v4(w, x);
+    planes[1] = sub_v4(w, x);
+    planes[2] = add_v4(w, y);
+    planes[3] = sub_v4(w, y);
+    planes[4] = w; // In front of the eye
+}
+
+// A box is outside when its corner furthest along some plane's normal is
+// still behind that plane
+int box_in_frustum(vec4 planes[5], vec4 min, vec4 max) {
+    for (int i = 0; i < 5; i++) {
+        vec4 plane = planes[i];
+        vec4 corner = {
+            plane.x > 0 ? max.x : min.x,
+            plane.y > 0 ? max.y : min.y,
+            plane.z > 0 ? max.z : min.z,
+            1
+        };
+
+        if (dotprod_v4(plane, corner) < 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void draw_indices(size_t first, size_t count) {
+    size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    glDrawElements(GL_TRIANGLES, count, index_type, (GLvoid *) (index_size * first));
+}
+
+// Coarsest level whose cubes look no larger than LOD_PIXELS from the
+// point of the chunk's box nearest the eye. The projection sees 90 degrees,
+// so a block at distance d covers screen_height / (2 d) pixels.
+int chunk_level(WorldChunk *chunk, vec4 eye, int screen_height) {
+    vec4 nearest = {
+        fmax(chunk->min.x, fmin(eye.x, chunk->max.x)),
+        fmax(chunk->min.y, fmin(eye.y, chunk->max.y)),
+        fmax(chunk->min.z, fmin(eye.z, chunk->max.z)),
+        1
+    };
+    float distance = mag_v4(sub_v4(eye, nearest));
+    int level = 0;
+
+    while (level + 1 < LOD_LEVELS && (2 << level) * screen_height <= 2 * distance * LOD_PIXELS) {
+        level++;
+    }
+
+    return level;
+}
+
+// Brings the level of a chunk to at most one above each neighbour it is
+// drawn with, so the sides coarse chunks close off are at most one step
+void clamp_chunk_level(size_t chunk, int seen) {
+    int x = chunk % chunks_x;
+    int z = chunk / chunks_x;
+    int chunks_z = num_chunks / chunks_x;
+
+    for (int direction = 0; direction < 4; direction++) {
+        int next_x = x + (direction == 0) - (direction == 2);
+        int next_z = z + (direction == 1) - (direction == 3);
+
+        if (next_x < 0 || next_z < 0 || next_x >= chunks_x || next_z >= chunks_z) {
+            continue;
+        }
+
+        size_t next = next_x + (size_t) next_z * chunks_x;
+
+        if (seen && chunk_seen_frame[next] != seen_frame) {
+            continue;
+        }
+
+        if (chunks[chunk].level > chunks[next].level + 1) {
+            chunks[chunk].level = chunks[next].level + 1;
+        }
+    }
+}
+
+// Directions from the eye that it sees through the openings passed so far,
+// counter-clockwise from right to left
+typedef struct {
+    vec2 right;
+    vec2 left;
+} SightWedge;
+
+float cross_v2(vec2 a, vec2 b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+void see_chunk(size_t chunk) {
+    if (chunk_seen_frame[chunk] != seen_frame) {
+        chunk_seen_frame[chunk] = seen_frame;
+        seen_chunks[seen_count++] = chunk;
+    }
+}
+
+// Adds the chunks under a cell, its walls and the cells around it. The tops
+// of the walls are uneven, so walls next to a cell in sight may show over
+// its own.
+void see_cell(int x, int y) {
+    int x_min = (x - 1) * CELL_SIZE_WITH_WALLS - world.min_x;
+    int x_max = (x + 2) * CELL_SIZE_WITH_WALLS - world.min_x;
+    int z_min = (y - 1) * CELL_SIZE_WITH_WALLS - world.min_z;
+    int z_max = (y + 2) * CELL_SIZE_WITH_WALLS - world.min_z;
+    int chunks_z = num_chunks / chunks_x;
+
+    x_min = x_min < 0 ? 0 : x_min / CHUNK_SIZE;
+    z_min = z_min < 0 ? 0 : z_min / CHUNK_SIZE;
+    x_max = x_max / CHUNK_SIZE < chunks_x ? x_max / CHUNK_SIZE : chunks_x - 1;
+    z_max = z_max / CHUNK_SIZE < chunks_z ? z_max / CHUNK_SIZE : chunks_z - 1;
+
+    for (int z = z_min; z <= z_max; z++) {
+        for (int x = x_min; x <= x_max; x++) {
+            see_chunk(x + z * chunks_x);
+        }
+    }
+}
+
+// Walls are only solid up to 2 + WALL_HEIGHT - REMOVE_DIST, their tops
+// reach the top of the world. Looking up past the walls of a cell, the
+// eye can see tops sight_reach times as far as the cell. Adds the chunks
+// in the wedge that comes into the cell out to there, or all around when
+// the wedge is NULL.
+void see_over_walls(int x, int y, vec2 eye, const SightWedge *wedge) {
+    float cell_x = x * CELL_SIZE_WITH_WALLS;
+    float cell_z = y * CELL_SIZE_WITH_WALLS;
+    float far_x = fmax(fabs(cell_x - eye.x), fabs(cell_x + CELL_SIZE_WITH_WALLS + 1 - eye.x));
+    float far_z = fmax(fabs(cell_z - eye.y), fabs(cell_z + CELL_SIZE_WITH_WALLS + 1 - eye.y));
+    float radius = sqrt(far_x * far_x + far_z * far_z) * sight_reach;
+    int chunks_z = num_chunks / chunks_x;
+    int x_min = fmax(0, floor((eye.x - radius - world.min_x) / CHUNK_SIZE));
+    int z_min = fmax(0, floor((eye.y - radius - world.min_z) / CHUNK_SIZE));
+    int x_max = fmin(chunks_x - 1, floor((eye.x + radius - world.min_x) / CHUNK_SIZE));
+    int z_max = fmin(chunks_z - 1, floor((eye.y + radius - world.min_z) / CHUNK_SIZE));
+
+    for (int z = z_min; z <= z_max; z++) {
+        for (int x = x_min; x <= x_max; x++) {
+            vec2 low = { world.min_x + x * CHUNK_SIZE - eye.x, world.min_z + z * CHUNK_SIZE - eye.y };
+            vec2 high = { low.x + CHUNK_SIZE, low.y + CHUNK_SIZE };
+            float near_x = fmax(0, fmax(low.x, -high.x));
+            float near_z = fmax(0, fmax(low.y, -high.y));
+
+            if (near_x * near_x + near_z * near_z > radius * radius) {
+                continue;
+            }
+
+            if (wedge != NULL) {
+                vec2 corners[4] = { low, { high.x, low.y }, high, { low.x, high.y } };
+                int right = 0;
+                int left = 0;
+
+                // Outside when every corner is past the same side
+                for (int i = 0; i < 4; i++) {
+                    right += cross_v2(wedge->right, corners[i]) < 0;
+                    left += cross_v2(wedge->left, corners[i]) > 0;
+                }
+
+                if (right == 4 || left == 4) {
+                    continue;
+                }
+            }
+
+            see_chunk(x + z * chunks_x);
+        }
+    }
+}
+
+// Adds every chunk that reaches past the maze, the island around it
+void see_outside() {
+    int maze_x_size = maze_width * CELL_SIZE_WITH_WALLS + 1;
+    int maze_z_size = maze_height * CELL_SIZE_WITH_WALLS + 1;
+
+    for (size_t i = 0; i < num_chunks; i++) {
+        int x, z, size_x, size_z;
+
+        chunk_box(i, &x, &z, &size_x, &size_z);
+
+        if (x < 0 || z < 0 || x + size_x > maze_x_size || z + size_z > maze_z_size) {
+            see_chunk(i);
+        }
+    }
+}
+
+// Direction 0 to 3 is +x, +y, -x, -y on the maze as in move_direction
+int cell_open(int x, int y, int direction) {
+    switch (direction) {
+        case 0:
+            return !maze_right(maze, x, y);
+        case 1:
+            return !maze_bottom(maze, x, y);
+        case 2:
+            return !maze_left(maze, x, y);
+        default:
+            return !maze_top(maze, x, y);
+    }
+}
+
+// Directions from the eye through the opening on one side of a cell, taken
+// along the middle of the wall. Returns 0 when the opening is seen edge on.
+int opening_wedge(int x, int y, int direction, vec2 eye, SightWedge *wedge) {
+    float x_min = x * CELL_SIZE_WITH_WALLS;
+    float y_min = y * CELL_SIZE_WITH_WALLS;
+    float x_max = x_min + CELL_SIZE_WITH_WALLS;
+    float y_max = y_min + CELL_SIZE_WITH_WALLS;
+    vec2 a, b;
+
+    switch (direction) {
+        case 0:
+            a = (vec2) { x_max + 0.5, y_min + 1 };
+            b = (vec2) { x_max + 0.5, y_max };
+            break;
+        case 1:
+            a = (vec2) { x_min + 1, y_max + 0.5 };
+            b = (vec2) { x_max, y_max + 0.5 };
+            break;
+        case 2:
+            a = (vec2) { x_min + 0.5, y_min + 1 };
+            b = (vec2) { x_min + 0.5, y_max };
+            break;
+        default:
+            a = (vec2) { x_min + 1, y_min + 0.5 };
+            b = (vec2) { x_max, y_min + 0.5 };
+            break;
+    }
+
+    a = (vec2) { a.x - eye.x, a.y - eye.y };
+    b = (vec2) { b.x - eye.x, b.y - eye.y };
+
+    float turn = cross_v2(a, b);
+
+    if (fabs(turn) < 1e-6) {
+        return 0;
+    }
+
+    wedge->right = turn > 0 ? a : b;
+    wedge->left = turn > 0 ? b : a;
+
+    return 1;
+}
+
+// Sees into the cells past the openings of a cell that are in sight, then
+// on through theirs. A NULL wedge sees through every opening.
+void walk_sight(int x, int y, int from, vec2 eye, const SightWedge *wedge) {
+    see_over_walls(x, y, eye, wedge);
+
+    for (int direction = 0; direction < 4; direction++) {
+        SightWedge opening;
+
+        if (direction == from || !cell_open(x, y, direction) || !opening_wedge(x, y, direction, eye, &opening)) {
+            continue;
+        }
+
+        if (wedge != NULL) {
+            if (cross_v2(wedge->right, opening.right) < 0) {
+                opening.right = wedge->right;
+            }
+
+            if (cross_v2(wedge->left, opening.left) > 0) {
+                opening.left = wedge->left;
+            }
+
+            if (cross_v2(opening.right, opening.left) < 0) {
+                continue;
+            }
+        }
+
+        int next_x = x + (direction == 0) - (direction == 2);
+        int next_y = y + (direction == 1) - (direction == 3);
+
+        if (next_x < 0 || next_y < 0 || next_x >= maze_width || next_y >= maze_height) {
+            outside_seen = 1;
+            continue;
+        }
+
+        see_cell(next_x, next_y);
+        walk_sight(next_x, next_y, (direction + 2) % 4, eye, &opening);
+    }
+}
+
+int compare_chunks(const void *a, const void *b) {
+    size_t first = *(const size_t *) a;
+    size_t second = *(const size_t *) b;
+
+    return (first > second) - (first < second);
+}
+
+// Fills seen_chunks in order for an eye inside the maze and below the tops
+// of its walls. Returns 0 for any other eye, which may see every chunk.
+int find_seen_chunks(vec4 eye) {
+    int x = floor(eye.x / CELL_SIZE_WITH_WALLS);
+    int y = floor(eye.z / CELL_SIZE_WITH_WALLS);
+
+    // Walls are solid up to here
+    if (eye.y >= 2 + WALL_HEIGHT - REMOVE_DIST || x < 0 || y < 0 || x >= maze_width || y >= maze_height) {
+        return 0;
+    }
+
+    seen_frame++;
+    seen_count = 0;
+    outside_seen = 0;
+    sight_reach = (world.min_y + world.size_y - eye.y) / (2 + WALL_HEIGHT - REMOVE_DIST - eye.y);
+
+    // The eye may stand in an opening of its cell, so the cells next to it
+    // see through every opening too
+    vec2 from = { eye.x, eye.z };
+
+    see_cell(x, y);
+    see_over_walls(x, y, from, NULL);
+
+    for (int direction = 0; direction < 4; direction++) {
+        int next_x = x + (direction == 0) - (direction == 2);
+        int next_y = y + (direction == 1) - (direction == 3);
+
+        if (!cell_open(x, y, direction)) {
+            continue;
+        } else if (next_x < 0 || next_y < 0 || next_x >= maze_width || next_y >= maze_height) {
+            outside_seen = 1;
+        } else {
+            see_cell(next_x, next_y);
+            walk_sight(next_x, next_y, (direction + 2) % 4, from, NULL);
+        }
+    }
+
+    if (outside_seen) {
+        see_outside();
+    }
+
+    qsort(seen_chunks, seen_count, sizeof(size_t), compare_chunks);
+    return 1;
+}
+
+// Draws the chunks whose boxes are in view, each at the level of detail its
+// distance allows. Inside the maze only chunks in sight are considered.
+// Ranges that follow each other in the index buffer are drawn with one call.
+void draw_visible_chunks() {
+    vec4 planes[5];
+    size_t first = 0;
+    size_t count = 0;
+    mat4 model_view_ctm = matrixmult_mat4(model_view, ctm);
+    vec4 move = model_view_ctm.w;
+
+    // The eye in world coordinates. model_view * ctm only rotates and moves,
+    // so it is the move taken back through the transposed rotation.
+    vec4 eye = {
+        -dotprod_v4(model_view_ctm.x, move), -dotprod_v4(model_view_ctm.y, move), -dotprod_v4(model_view_ctm.z, move), 1
+    };
+    int screen_height = glutGet(GLUT_WINDOW_HEIGHT);
+
+    frustum_planes(matrixmult_mat4(projection, model_view_ctm), planes);
+
+    int seen = find_seen_chunks(eye);
+    size_t candidates = seen ? seen_count : num_chunks;
+
+    for (size_t n = 0; n < candidates; n++) {
+        WorldChunk *chunk = &chunks[seen ? seen_chunks[n] : n];
+
+        chunk->level = chunk_level(chunk, eye, screen_height);
+    }
+
+    // A chunk's level can only be lowered by chunks up to LOD_LEVELS - 1
+    // away, each pass reaches one further
+    for (int pass = 1; pass < LOD_LEVELS; pass++) {
+        for (size_t n = 0; n < candidates; n++) {
+            clamp_chunk_level(seen ? seen_chunks[n] : n, seen);
+        }
+    }
+
+    for (size_t n = 0; n < candidates; n++) {
+        WorldChunk *chunk = &chunks[seen ? seen_chunks[n] : n];
+
+        if (chunk->index_count[0] == 0 || !box_in_frustum(planes, chunk->min, chunk->max)) {
+            continue;
+        }
+
+        int level = chunk->level;
+
+        if (count > 0 && first + count == chunk->first_index[level]) {
+            count += chunk->index_count[level];
+        } else {
+            if (count > 0) {
+                draw_indices(first, count);
+            }
+
+            first = chunk->first_index[level];
+            count = chunk->index_count[level];
+        }
+    }
+
+    if (count > 0) {
+        draw_indices(first, count);
+    }
+}
+
 void display(void)
 {
     glClearColor(120.0/255.0, 167.0/255.0, 1.0, 1.0); // Set clear color to the minecraft sky color
@@ -1432,28 +2557,203 @@ void display(void)
 
 
     glUniformMatrix4fv(current_transformation_matrix, 1, GL_FALSE, (GLfloat *) &ctm);
-    glDrawArrays(GL_TRIANGLES, 0, num_vertices - 36);
+
+    #ifndef __APPLE__
+    if (instanced_rendering) {
+        glUniform1i(instanced_location, 1);
+        glBindVertexArray(instance_vao);
+        glDrawElementsInstancedARB(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (GLvoid *) 0, num_instances);
+        glBindVertexArray(world_vao);
+        glUniform1i(instanced_location, 0);
+    }
+    #endif
+
+    draw_visible_chunks();
+    draw_indices(num_indices - 72, 36); // Sun
 
     glUniformMatrix4fv(current_sun_matrix, 1, GL_FALSE, (GLfloat *) &sun_ctm);
-    glDrawArrays(GL_TRIANGLES, num_vertices - 36, num_vertices);
+    draw_indices(num_indices - 36, 36);
 
     glutSwapBuffers();
 }
 
+void print_usage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --size W H                   Maze size, skips the prompt\n");
+    printf("  --seed N                     Seed for the maze and island (default: current time)\n");
+    printf("  --threads N                  Threads for generation, validation and queries (default: all cores)\n");
+    printf("  --generator recursive|eller  Maze generator (default: recursive)\n");
+    printf("  --ascii FILE                 Write the maze as text to FILE ('-' for stdout) and exit\n");
+    printf("  --pbm FILE                   Write the maze as a 1-bit PBM image and exit\n");
+    printf("  --pgm FILE                   Write the maze as an 8-bit PGM image and exit\n");
+    printf("  --validate FILE              Check the maze is perfect and write a JSON report ('-' for stdout)\n");
+    printf("  --save FILE                  Write the maze as a binary .maze file and exit\n");
+    printf("  --load FILE                  Open a .maze file instead of generating a maze\n");
+    printf("  --verify                     Check the checksum of the loaded file\n");
+    printf("  --queries N                  Solve N random path queries in parallel, report queries/s and exit\n");
+    printf("  --solve bfs|astar|bitset     Time one search from the entrance to the exit and exit\n");
+    printf("  --speed N                    Cells per second walked in fast navigation (default: 8)\n");
+    printf("  --instanced                  Draw every exposed block as an instance of one cube instead of meshing\n");
+}
+
+// Reads text that is a whole decimal number from min to max, returns 0 if
+// it is anything else
+int parse_number(const char *text, long min, long max, long *value) {
+    char *end;
+
+    errno = 0;
+    *value = strtol(text, &end, 10);
+
+    return errno == 0 && end != text && *end == '\0' && *value >= min && *value <= max;
+}
+
+// Reads our long options; anything else is left for glutInit
+void parse_arguments(int argc, char **argv) {
+    seed = time(NULL);
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            continue;
+        }
+
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            int ok;
+            seed = parse_seed(argv[++i], &ok);
+
+            if (!ok) {
+                printf("\nInvalid seed: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            long width, height;
+            i += 2;
+
+            if (!parse_number(argv[i - 1], 1, INT_MAX, &width) || !parse_number(argv[i], 1, INT_MAX, &height)) {
+                printf("\nInvalid size: %s %s\n", argv[i - 1], argv[i]);
+                exit(1);
+            }
+
+            maze_width = width;
+            maze_height = height;
+        } else if (strcmp(argv[i], "--generator") == 0 && i + 1 < argc) {
+            i++;
+
+            if (strcmp(argv[i], "recursive") == 0) {
+                generator = GENERATOR_RECURSIVE;
+            } else if (strcmp(argv[i], "eller") == 0) {
+                generator = GENERATOR_ELLER;
+            } else {
+                printf("\nUnknown generator: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--ascii") == 0 && i + 1 < argc) {
+            ascii_path = argv[++i];
+        } else if (strcmp(argv[i], "--pbm") == 0 && i + 1 < argc) {
+            pbm_path = argv[++i];
+        } else if (strcmp(argv[i], "--pgm") == 0 && i + 1 < argc) {
+            pgm_path = argv[++i];
+        } else if (strcmp(argv[i], "--validate") == 0 && i + 1 < argc) {
+            validate_path = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            load_path = argv[++i];
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify_load = 1;
+        } else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            long count;
+
+            if (!parse_number(argv[++i], 1, LONG_MAX, &count)) {
+                printf("\nInvalid query count: %s\n", argv[i]);
+                exit(1);
+            }
+
+            query_count = count;
+        } else if (strcmp(argv[i], "--solve") == 0 && i + 1 < argc) {
+            i++;
+
+            if (strcmp(argv[i], "bfs") == 0) {
+                solve_method = SOLVER_BFS;
+            } else if (strcmp(argv[i], "astar") == 0) {
+                solve_method = SOLVER_ASTAR;
+            } else if (strcmp(argv[i], "bitset") == 0) {
+                solve_method = SOLVER_BITSET;
+            } else {
+                printf("\nUnknown solver: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--instanced") == 0) {
+            instanced_rendering = 1;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            char *end;
+
+            errno = 0;
+            navigation_speed = strtod(argv[++i], &end);
+
+            if (errno != 0 || end == argv[i] || *end != '\0' || !(navigation_speed > 0) || isinf(navigation_speed)) {
+                printf("\nInvalid speed: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            long count;
+
+            if (!parse_number(argv[++i], 0, INT_MAX, &count)) {
+                printf("\nInvalid thread count: %s\n", argv[i]);
+                exit(1);
+            }
+
+            thread_count = count;
+        } else {
+            print_usage(argv[0]);
+            exit(strcmp(argv[i], "--help") == 0 ? 0 : 1);
+        }
+    }
+}
+
 int main(int argc, char **argv)
 {
     define_blocks();
-    srand(time(NULL));
+    parse_arguments(argc, argv);
+
+    if (ascii_path != NULL || pbm_path != NULL || pgm_path != NULL || save_path != NULL || validate_path != NULL ||
+        query_count > 0 || solve_method >= 0) {
+        return export_maze();
+    }
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
     glutInitWindowSize(1024, 1024);
     glutInitWindowPosition(100,100);
     glutCreateWindow("Maze");
-    #ifndef __APPLE__
+    #ifdef __APPLE__
+    int instancing_supported = 0;
+    #else
     glewInit();
+    int instancing_supported = GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced;
     #endif
-    prompt_maze_size();
+
+    if (instanced_rendering && !instancing_supported) {
+        printf("Instanced rendering is not supported here, meshing the world instead\n");
+        instanced_rendering = 0;
+    }
+
+    if (load_path != NULL) {
+        load_maze();
+    } else {
+        prompt_maze_size();
+        create_maze();
+    }
+
+    printf("Width: %d Height: %d Seed: %" PRIu64 "\n", maze_width, maze_height, seed);
+
+    if ((size_t) maze_width * maze_height <= PRINT_MAZE_MAX_CELLS) {
+        print_maze(maze);
+    }
+
+    if (!build_direction_field(maze, maze_width - 1, maze_height - 1, &exit_field)) {
+        printf("Not enough memory for the exit field, solves will search the maze\n");
+    }
+
     generate_world();
     init();
     glutDisplayFunc(display);
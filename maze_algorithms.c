@@ -1,140 +1,581 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "maze_algorithms.h"
+#include "rng.h"
 
-void set_left(Cell **maze, int x, int y, int value) {
-    maze[x][y].left = value;
-    maze[x - 1][y].right = value;
+size_t maze_bytes(int width, int height) {
+    size_t stride = ((size_t) width + 64) / 64;
+
+    return sizeof(Maze) + sizeof(uint64_t) * stride * (2 * (size_t) height + 1);
+}
+
+Maze *maze_create(int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return NULL;
+    }
+
+    // Header and both wall bitmaps share one allocation
+    Maze *maze = malloc(maze_bytes(width, height));
+
+    if (maze == NULL) {
+        return NULL;
+    }
+
+    maze->width = width;
+    maze->height = height;
+    maze->stride = ((size_t) width + 64) / 64;
+    maze->vertical = (uint64_t *) (maze + 1);
+    maze->horizontal = maze->vertical + maze->stride * height;
+    maze->mapping = NULL;
+    maze->mapping_bytes = 0;
+
+    return maze;
+}
+
+void maze_free(Maze *maze) {
+    if (maze != NULL && maze->mapping != NULL) {
+        munmap(maze->mapping, maze->mapping_bytes);
+    }
+
+    free(maze);
+}
+
+void set_left(Maze *maze, int x, int y, int value) {
+    maze_set_bit(maze_vertical_line(maze, y), x, value);
 }
 
-void set_right(Cell **maze, int x, int y, int value) {
-    maze[x][y].right = value;
-    maze[x + 1][y].left = value;
+void set_right(Maze *maze, int x, int y, int value) {
+    maze_set_bit(maze_vertical_line(maze, y), x + 1, value);
 }
 
-void set_top(Cell **maze, int x, int y, int value) {
-    maze[x][y].top = value;
-    maze[x][y - 1].bottom = value;
+void set_top(Maze *maze, int x, int y, int value) {
+    maze_set_bit(maze_horizontal_line(maze, y), x, value);
 }
 
-void set_bottom(Cell **maze, int x, int y, int value) {
-    maze[x][y].bottom = value;
-    maze[x][y + 1].top = value;
+void set_bottom(Maze *maze, int x, int y, int value) {
+    maze_set_bit(maze_horizontal_line(maze, y + 1), x, value);
 }
 
-void generate_empty_maze(Cell **maze, int width, int height) {
+void generate_empty_maze(Maze *maze) {
+    int width = maze->width;
+    int height = maze->height;
+
     // Initialize values to open
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            maze[x][y] = (Cell) { 0, 0, 0, 0 };
-        }
-    }
+    memset(maze->vertical, 0, sizeof(uint64_t) * maze->stride * (2 * (size_t) height + 1));
 
     for (int x = 0; x < width; x++) {
-        maze[x][0].top = 1; // Maze top
-        maze[x][height - 1].bottom = 1; // Maze bottom
+        set_top(maze, x, 0, 1); // Maze top
+        set_bottom(maze, x, height - 1, 1); // Maze bottom
     }
 
     for (int y = 0; y < height; y++) {
-        maze[0][y].left = 1; // Maze left
-        maze[width - 1][y].right = 1; // Maze right
+        set_left(maze, 0, y, 1); // Maze left
+        set_right(maze, width - 1, y, 1); // Maze right
     }
 
     // Open starting points
-    maze[0][0].left = 0;
-    maze[width - 1][height - 1].right = 0;
+    set_left(maze, 0, 0, 0);
+    set_right(maze, width - 1, height - 1, 0);
+}
+
+// Regions at least this many cells are handed to the worker pool
+#define PARALLEL_REGION_CELLS (1 << 16)
+
+typedef struct {
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    uint64_t seed; // Region's own random stream, independent of which thread runs it
+} Region;
+
+typedef struct {
+    Region *regions;
+    size_t count;
+    size_t capacity;
+} RegionStack;
+
+typedef struct {
+    Maze *maze;
+    int shared; // Sibling regions may run concurrently and share words
+    RegionStack queue;
+    size_t pending; // Queued or in-progress regions from the shared queue
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} WorkQueue;
+
+static int push_region(RegionStack *stack, Region region) {
+    if (stack->count == stack->capacity) {
+        size_t capacity = stack->capacity ? stack->capacity * 2 : 64;
+        Region *regions = realloc(stack->regions, capacity * sizeof(Region));
+
+        if (regions == NULL) {
+            return 0;
+        }
+
+        stack->regions = regions;
+        stack->capacity = capacity;
+    }
+
+    stack->regions[stack->count++] = region;
+    return 1;
+}
+
+static void set_line_bit(uint64_t *line, int i, int value, int shared) {
+    if (!shared) {
+        maze_set_bit(line, i, value);
+        return;
+    }
+
+    uint64_t mask = (uint64_t) 1 << (i & 63);
+
+    if (value) {
+        __atomic_fetch_or(&line[i >> 6], mask, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&line[i >> 6], ~mask, __ATOMIC_RELAXED);
+    }
+}
+
+// Sets bits first..last of a line, a whole word at a time
+static void fill_line_bits(uint64_t *line, int first, int last, int shared) {
+    size_t first_word = first >> 6;
+    size_t last_word = last >> 6;
+    uint64_t first_mask = ~(uint64_t) 0 << (first & 63);
+    uint64_t last_mask = ~(uint64_t) 0 >> (63 - (last & 63));
+
+    for (size_t w = first_word; w <= last_word; w++) {
+        uint64_t mask = ~(uint64_t) 0;
+
+        if (w == first_word) {
+            mask &= first_mask;
+        }
+
+        if (w == last_word) {
+            mask &= last_mask;
+        }
+
+        if (shared) {
+            __atomic_fetch_or(&line[w], mask, __ATOMIC_RELAXED);
+        } else {
+            line[w] |= mask;
+        }
+    }
 }
 
-void generate_recursive(Cell **maze, int x1, int y1, int x2, int y2) {
+// Places the cross walls of one region and returns its quadrants.
+// Returns the number of quadrants, 0 if the region is a single row or column.
+static int divide_region(Maze *maze, Region *region, Region quadrants[4], int shared) {
+    int x1 = region->x1;
+    int y1 = region->y1;
+    int x2 = region->x2;
+    int y2 = region->y2;
     int x_range = x2 - x1;
     int y_range = y2 - y1;
+    Rng rng;
 
     // Stop if width or height is 1
     if (x_range == 0 || y_range == 0) {
-        return;
+        return 0;
     }
 
+    rng_init(&rng, region->seed);
+
     // Pick center
-    int x_center = x1 + rand() % x_range;
-    int y_center = y1 + rand() % y_range;
+    int x_center = x1 + rng_below(&rng, x_range);
+    int y_center = y1 + rng_below(&rng, y_range);
+
+    uint64_t *horizontal = maze_horizontal_line(maze, y_center + 1);
 
     // Create horizontal walls
-    for (int x = x1; x <= x2; x++) {
-        set_bottom(maze, x, y_center, 1);
-    }
+    fill_line_bits(horizontal, x1, x2, shared);
 
     // Create vertical walls
     for (int y = y1; y <= y2; y++) {
-        set_right(maze, x_center, y, 1);
+        set_line_bit(maze_vertical_line(maze, y), x_center + 1, 1, shared);
     }
 
     // Remove three walls
     int walls[4] = { 1, 1, 1, 1 };
-    walls[rand() % 4] = 0;
+    walls[rng_below(&rng, 4)] = 0;
 
     // Remove top wall
     if (walls[0]) {
         int size = y_center - y1 + 1;
-        int y = y1 + rand() % size;
-        set_right(maze, x_center, y, 0);
+        int y = y1 + rng_below(&rng, size);
+        set_line_bit(maze_vertical_line(maze, y), x_center + 1, 0, shared);
     }
 
     // Remove right wall
     if (walls[1]) {
         int size = x2 - x_center;
-        int x = x_center + 1 + rand() % size;
-        set_bottom(maze, x, y_center, 0);
+        int x = x_center + 1 + rng_below(&rng, size);
+        set_line_bit(horizontal, x, 0, shared);
     }
 
     // Remove bottom wall
     if (walls[2]) {
         int size = y2 - y_center;
-        int y = y_center + 1 + rand() % size;
-        set_right(maze, x_center, y, 0);
+        int y = y_center + 1 + rng_below(&rng, size);
+        set_line_bit(maze_vertical_line(maze, y), x_center + 1, 0, shared);
     }
 
     // Remove left wall
     if (walls[3]) {
         int size = x_center - x1 + 1;
-        int x = x1 + rand() % size;
-        set_bottom(maze, x, y_center, 0);
+        int x = x1 + rng_below(&rng, size);
+        set_line_bit(horizontal, x, 0, shared);
+    }
+
+    quadrants[0] = (Region) { x1, y1, x_center, y_center, rng_split(&rng) }; // Top left
+    quadrants[1] = (Region) { x_center + 1, y1, x2, y_center, rng_split(&rng) }; // Top right
+    quadrants[2] = (Region) { x1, y_center + 1, x_center, y2, rng_split(&rng) }; // Bottom left
+    quadrants[3] = (Region) { x_center + 1, y_center + 1, x2, y2, rng_split(&rng) }; // Bottom right
+
+    return 4;
+}
+
+static size_t region_cells(Region region) {
+    return (size_t) (region.x2 - region.x1 + 1) * (size_t) (region.y2 - region.y1 + 1);
+}
+
+static void queue_region(WorkQueue *work, Region region) {
+    pthread_mutex_lock(&work->lock);
+
+    if (!push_region(&work->queue, region)) {
+        printf("\nOut of memory while generating maze! Exiting...\n");
+        exit(1);
+    }
+
+    work->pending++;
+    pthread_cond_signal(&work->ready);
+    pthread_mutex_unlock(&work->lock);
+}
+
+// Divides a region and all of its descendants using an explicit stack.
+// Large descendants are passed back to the shared queue when there is one.
+static void generate_region(WorkQueue *work, RegionStack *stack, Region region) {
+    stack->count = 0;
+
+    if (!push_region(stack, region)) {
+        printf("\nOut of memory while generating maze! Exiting...\n");
+        exit(1);
+    }
+
+    while (stack->count > 0) {
+        Region current = stack->regions[--stack->count];
+        Region quadrants[4];
+        int count = divide_region(work->maze, &current, quadrants, work->shared);
+
+        for (int i = 0; i < count; i++) {
+            if (work->shared && region_cells(quadrants[i]) >= PARALLEL_REGION_CELLS) {
+                queue_region(work, quadrants[i]);
+            } else if (!push_region(stack, quadrants[i])) {
+                printf("\nOut of memory while generating maze! Exiting...\n");
+                exit(1);
+            }
+        }
+    }
+}
+
+static void *generate_worker(void *arg) {
+    WorkQueue *work = arg;
+    RegionStack stack = { NULL, 0, 0 };
+
+    pthread_mutex_lock(&work->lock);
+
+    while (1) {
+        while (work->queue.count == 0 && work->pending > 0) {
+            pthread_cond_wait(&work->ready, &work->lock);
+        }
+
+        if (work->queue.count == 0) {
+            break; // Everything is done
+        }
+
+        Region region = work->queue.regions[--work->queue.count];
+        pthread_mutex_unlock(&work->lock);
+
+        generate_region(work, &stack, region);
+
+        pthread_mutex_lock(&work->lock);
+
+        if (--work->pending == 0) {
+            pthread_cond_broadcast(&work->ready);
+        }
+    }
+
+    pthread_mutex_unlock(&work->lock);
+    free(stack.regions);
+
+    return NULL;
+}
+
+int default_thread_count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int) count : 1;
+}
+
+void generate_maze(Maze *maze, uint64_t seed, int threads) {
+    generate_empty_maze(maze);
+
+    Region root = { 0, 0, maze->width - 1, maze->height - 1, rng_mix(seed) };
+
+    if (threads <= 0) {
+        threads = default_thread_count();
+    }
+
+    // Not worth starting threads for a maze the size of one region
+    if (threads == 1 || region_cells(root) < PARALLEL_REGION_CELLS) {
+        WorkQueue work = { .maze = maze, .shared = 0 };
+        RegionStack stack = { NULL, 0, 0 };
+
+        generate_region(&work, &stack, root);
+        free(stack.regions);
+        return;
+    }
+
+    WorkQueue work = { .maze = maze, .shared = 1 };
+    pthread_mutex_init(&work.lock, NULL);
+    pthread_cond_init(&work.ready, NULL);
+    queue_region(&work, root);
+
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+
+    if (workers != NULL) {
+        for (; started < threads; started++) {
+            if (pthread_create(&workers[started], NULL, generate_worker, &work) != 0) {
+                break;
+            }
+        }
     }
-    
-    // Recurse for each quadrant
-    generate_recursive(maze, x1, y1, x_center, y_center); // Top left
-    generate_recursive(maze, x_center + 1, y1, x2, y_center); // Top right
-    generate_recursive(maze, x1, y_center + 1, x_center, y2); // Bottom left
-    generate_recursive(maze, x_center + 1, y_center + 1, x2, y2); // Bottom right
+
+    // Fall back to generating on this thread if no worker could start
+    if (started == 0) {
+        generate_worker(&work);
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    free(work.queue.regions);
+    pthread_mutex_destroy(&work.lock);
+    pthread_cond_destroy(&work.ready);
+}
+
+// Eller's algorithm: builds the maze one row at a time, keeping only the
+// set membership of the current row. Rows are handed to the callback as
+// soon as they are final.
+//
+// A set is named after one of its cells in the current row, so labels are
+// always below width and never need compacting. The inner loops use
+// selects instead of branches since every decision is a coin flip.
+typedef struct {
+    int width;
+    int *label; // Set of each cell in the current row
+    int *parent; // Union-find over labels
+    int *last_cell; // Last cell of each set in the row
+    int *open_cell; // A cell of each set that opens down
+    char *has_down; // Whether each set already opens down
+    Rng rng;
+    uint64_t coins; // Unused random bits for coin flips
+    int coins_left;
+} EllerState;
+
+static int flip_coin(EllerState *state) {
+    if (state->coins_left == 0) {
+        state->coins = rng_next(&state->rng);
+        state->coins_left = 64;
+    }
+
+    int coin = state->coins & 1;
+    state->coins >>= 1;
+    state->coins_left--;
+
+    return coin;
+}
+
+static int find_set(int *parent, int label) {
+    while (parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+
+    return label;
 }
 
-void generate_maze(Cell **maze, int width, int height) {
-    generate_empty_maze(maze, width, height);
-    generate_recursive(maze, 0, 0, width - 1, height - 1);
+static inline void or_bit(uint64_t *line, int i, uint64_t value) {
+    line[i >> 6] |= value << (i & 63);
 }
 
-void print_maze(Cell **maze, int width, int height) {
+int generate_maze_rows(int width, int height, uint64_t seed, MazeRowFunc callback, void *context) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    size_t stride = ((size_t) width + 64) / 64;
+    size_t line_bytes = stride * sizeof(uint64_t);
+    uint64_t last_word_mask = ~(uint64_t) 0 >> (63 - ((width - 1) & 63));
+    size_t last_word = (width - 1) >> 6;
+
+    // Per-row buffers, nothing here grows with the height
+    EllerState state = { .width = width };
+    state.label = malloc(width * sizeof(int));
+    state.parent = malloc(width * sizeof(int));
+    state.last_cell = malloc(width * sizeof(int));
+    state.open_cell = malloc(width * sizeof(int));
+    state.has_down = malloc(width);
+    uint64_t *top = calloc(stride, sizeof(uint64_t));
+    uint64_t *vertical = malloc(line_bytes);
+    uint64_t *bottom = calloc(stride, sizeof(uint64_t));
+    int completed = 0;
+
+    if (state.label == NULL || state.parent == NULL || state.last_cell == NULL ||
+        state.open_cell == NULL || state.has_down == NULL ||
+        top == NULL || vertical == NULL || bottom == NULL) {
+        goto done;
+    }
+
+    rng_init_stream(&state.rng, seed, GENERATOR_ELLER);
+
+    // Maze top, every cell starts in its own set
+    for (int x = 0; x < width; x++) {
+        maze_set_bit(top, x, 1);
+        state.label[x] = x;
+    }
+
     for (int y = 0; y < height; y++) {
+        int last_row = y == height - 1;
+
+        for (int x = 0; x < width; x++) {
+            state.parent[x] = x;
+        }
+
+        // Join neighbours in different sets, all of them on the last row
+        memset(vertical, 0, line_bytes);
+        maze_set_bit(vertical, 0, y != 0); // Entrance at the top left
+        maze_set_bit(vertical, width, !last_row); // Exit at the bottom right
+
+        int a = state.label[0];
+
+        for (int x = 0; x < width - 1; x++) {
+            int b = find_set(state.parent, state.label[x + 1]);
+            int join = (a != b) & (last_row | flip_coin(&state));
+
+            state.parent[b] = join ? a : b;
+            or_bit(vertical, x + 1, !join);
+            a = join ? a : b; // Root of x + 1
+        }
+
         for (int x = 0; x < width; x++) {
-            Cell cell = maze[x][y];
-            printf("+%s", cell.top ? "---" : "   ");
+            int set = find_set(state.parent, state.label[x]);
+            state.label[x] = set;
+            state.has_down[set] = 0;
+        }
+
+        if (last_row) {
+            for (size_t w = 0; w < stride; w++) {
+                bottom[w] = w < last_word ? ~(uint64_t) 0 : w == last_word ? last_word_mask : 0;
+            }
+        } else {
+            // Random bottom walls, then open the last cell of any set
+            // that has no way down
+            for (size_t w = 0; w < stride; w++) {
+                bottom[w] = w < last_word ? rng_next(&state.rng) : w == last_word ? rng_next(&state.rng) & last_word_mask : 0;
+            }
+
+            for (int x = 0; x < width; x++) {
+                int set = state.label[x];
+                state.last_cell[set] = x;
+                state.has_down[set] |= !maze_get_bit(bottom, x);
+            }
+
+            for (int x = 0; x < width; x++) {
+                int set = state.label[x];
+                uint64_t stuck = !state.has_down[set] & (state.last_cell[set] == x);
+
+                bottom[x >> 6] &= ~(stuck << (x & 63));
+            }
+        }
+
+        MazeRow row = { width, y, top, vertical };
+
+        if (!callback(&row, context)) {
+            goto done;
         }
 
-        printf("+\n");
+        // Cells below an opening stay in their set, named after its last
+        // open cell. The rest start new sets named after themselves.
+        for (int x = 0; x < width; x++) {
+            int set = state.label[x];
+            state.open_cell[set] = maze_get_bit(bottom, x) ? state.open_cell[set] : x;
+        }
 
         for (int x = 0; x < width; x++) {
-            Cell cell = maze[x][y];
-            printf("%c   ", cell.left ? '|' : ' ');
+            state.label[x] = maze_get_bit(bottom, x) ? x : state.open_cell[state.label[x]];
         }
 
-        printf("%c\n", maze[width - 1][y].right ? '|' : ' ');
+        uint64_t *swap = top;
+        top = bottom;
+        bottom = swap;
     }
 
-    // Bottom of maze
-    for (int x = 0; x < width; x++) {
-        Cell cell = maze[x][height - 1];
-        printf("+%s", cell.bottom ? "---" : "   ");
+    // Maze bottom
+    MazeRow row = { width, height, top, NULL };
+    completed = callback(&row, context);
+
+done:
+    free(state.label);
+    free(state.parent);
+    free(state.last_cell);
+    free(state.open_cell);
+    free(state.has_down);
+    free(top);
+    free(vertical);
+    free(bottom);
+
+    return completed;
+}
+
+static int store_maze_row(const MazeRow *row, void *context) {
+    Maze *maze = context;
+    size_t line_bytes = maze->stride * sizeof(uint64_t);
+
+    memcpy(maze_horizontal_line(maze, row->y), row->top, line_bytes);
+
+    if (row->vertical != NULL) {
+        memcpy(maze_vertical_line(maze, row->y), row->vertical, line_bytes);
+    }
+
+    return 1;
+}
+
+int generate_maze_eller(Maze *maze, uint64_t seed) {
+    return generate_maze_rows(maze->width, maze->height, seed, store_maze_row, maze);
+}
+
+// Passes a stored maze to a row consumer, the same way generate_maze_rows does
+int for_each_maze_row(const Maze *maze, MazeRowFunc callback, void *context) {
+    for (int y = 0; y <= maze->height; y++) {
+        MazeRow row = {
+            maze->width,
+            y,
+            maze_horizontal_line(maze, y),
+            y < maze->height ? maze_vertical_line(maze, y) : NULL
+        };
+
+        if (!callback(&row, context)) {
+            return 0;
+        }
     }
 
-    printf("+\n");
-}
\ No newline at end of file
+    return 1;
+}
@@ -1,6 +1,9 @@
 #ifndef MAZE_ALGORITHMS_H
 #define MAZE_ALGORITHMS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct {
     int top;
     int right;
@@ -8,7 +11,130 @@ typedef struct {
     int left;
 } Cell;
 
-void generate_maze(Cell **maze, int width, int height);
-void print_maze(Cell **maze, int width, int height);
+// Bit-packed maze: one bit per wall, shared walls are stored once.
+// Vertical line i of row y is the wall on the left of cell (i, y), so
+// line width is the right border. Horizontal line j of column x is the
+// wall above cell (x, j), so line height is the bottom border.
+typedef struct {
+    int width;
+    int height;
+    size_t stride; // 64-bit words per line
+    uint64_t *vertical; // height lines of width + 1 bits
+    uint64_t *horizontal; // height + 1 lines of width bits
+    void *mapping; // File mapping holding the lines, NULL if they follow the header
+    size_t mapping_bytes;
+} Maze;
+
+Maze *maze_create(int width, int height);
+void maze_free(Maze *maze);
+size_t maze_bytes(int width, int height);
+
+static inline int maze_get_bit(const uint64_t *line, int i) {
+    return (line[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void maze_set_bit(uint64_t *line, int i, int value) {
+    uint64_t mask = (uint64_t) 1 << (i & 63);
+
+    if (value) {
+        line[i >> 6] |= mask;
+    } else {
+        line[i >> 6] &= ~mask;
+    }
+}
+
+static inline uint64_t *maze_vertical_line(const Maze *maze, int y) {
+    return maze->vertical + (size_t) y * maze->stride;
+}
+
+static inline uint64_t *maze_horizontal_line(const Maze *maze, int y) {
+    return maze->horizontal + (size_t) y * maze->stride;
+}
+
+static inline int maze_left(const Maze *maze, int x, int y) {
+    return maze_get_bit(maze_vertical_line(maze, y), x);
+}
+
+static inline int maze_right(const Maze *maze, int x, int y) {
+    return maze_get_bit(maze_vertical_line(maze, y), x + 1);
+}
+
+static inline int maze_top(const Maze *maze, int x, int y) {
+    return maze_get_bit(maze_horizontal_line(maze, y), x);
+}
+
+static inline int maze_bottom(const Maze *maze, int x, int y) {
+    return maze_get_bit(maze_horizontal_line(maze, y + 1), x);
+}
+
+static inline Cell maze_get_cell(const Maze *maze, int x, int y) {
+    return (Cell) {
+        maze_top(maze, x, y),
+        maze_right(maze, x, y),
+        maze_bottom(maze, x, y),
+        maze_left(maze, x, y)
+    };
+}
+
+// Bits of word i of a line that belong to the first count cells
+static inline uint64_t maze_word_mask(size_t word, int count) {
+    int start = word * 64;
+
+    if (count >= start + 64) {
+        return ~(uint64_t) 0;
+    }
+
+    return count <= start ? 0 : ~(uint64_t) 0 >> (64 - (count - start));
+}
+
+// Directions match the player facing: 0 pos x, 1 pos y, 2 neg x, 3 neg y.
+// Bit d is set when a step in direction d from (x, y) stays in the maze.
+static inline int maze_open_directions(const Maze *maze, int x, int y) {
+    const uint64_t *vertical = maze_vertical_line(maze, y);
+    int open = 0;
+
+    open |= (x < maze->width - 1 && !maze_get_bit(vertical, x + 1)) << 0;
+    open |= (y < maze->height - 1 && !maze_bottom(maze, x, y)) << 1;
+    open |= (x > 0 && !maze_get_bit(vertical, x)) << 2;
+    open |= (y > 0 && !maze_top(maze, x, y)) << 3;
+
+    return open;
+}
+
+// Index of the cell one step away, cells are numbered row by row
+static inline uint64_t maze_step_cell(uint64_t cell, int width, int direction) {
+    switch (direction) {
+        case 0:
+            return cell + 1;
+        case 1:
+            return cell + width;
+        case 2:
+            return cell - 1;
+        default:
+            return cell - width;
+    }
+}
+
+// Generator backends
+#define GENERATOR_RECURSIVE 0
+#define GENERATOR_ELLER 1
+
+// One row of walls, laid out like the lines of a Maze. The last row
+// (y == height) only carries the bottom border and has no vertical line.
+typedef struct {
+    int width;
+    int y;
+    const uint64_t *top;
+    const uint64_t *vertical;
+} MazeRow;
+
+// Row consumer, returns 0 to stop early
+typedef int (*MazeRowFunc)(const MazeRow *row, void *context);
+
+int default_thread_count();
+void generate_maze(Maze *maze, uint64_t seed, int threads);
+int generate_maze_eller(Maze *maze, uint64_t seed);
+int generate_maze_rows(int width, int height, uint64_t seed, MazeRowFunc callback, void *context);
+int for_each_maze_row(const Maze *maze, MazeRowFunc callback, void *context);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "maze_algorithms.h"
+#include "maze_solver.h"
+#include "maze_graph.h"
+#include "maze_validate.h"
+#include "arena.h"
+#include "rng.h"
+
+// Checks run by make check. Every solver has to find a path of the same
+// length between the same cells, and the validator has to accept the
+// mazes of both generators.
+
+#define QUERIES 32
+
+static int failures = 0;
+
+static void fail(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    failures++;
+}
+
+// Whether cells is a walk through open walls from the start to the goal
+static int path_is_valid(const Maze *maze, const PathCell *cells, size_t length, const PathQuery *query) {
+    if (length == 0 || cells[0].x != query->start_x || cells[0].y != query->start_y ||
+        cells[length - 1].x != query->goal_x || cells[length - 1].y != query->goal_y) {
+        return 0;
+    }
+
+    for (size_t i = 1; i < length; i++) {
+        int dx = cells[i].x - cells[i - 1].x;
+        int dy = cells[i].y - cells[i - 1].y;
+        int x = cells[i - 1].x;
+        int y = cells[i - 1].y;
+        int open;
+
+        if (dx == 1 && dy == 0) {
+            open = !maze_right(maze, x, y);
+        } else if (dx == -1 && dy == 0) {
+            open = !maze_left(maze, x, y);
+        } else if (dx == 0 && dy == 1) {
+            open = !maze_bottom(maze, x, y);
+        } else if (dx == 0 && dy == -1) {
+            open = !maze_top(maze, x, y);
+        } else {
+            open = 0;
+        }
+
+        if (!open) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void check_path(const char *name, const char *solver, const Maze *maze, const PathQuery *query, int found,
+                       const PathCell *cells, size_t length, size_t expected) {
+    if (!found) {
+        fail("%s: %s found no path from (%d, %d) to (%d, %d)", name, solver, query->start_x, query->start_y,
+            query->goal_x, query->goal_y);
+    } else if (!path_is_valid(maze, cells, length, query)) {
+        fail("%s: %s path from (%d, %d) to (%d, %d) is not a walk through the maze", name, solver,
+            query->start_x, query->start_y, query->goal_x, query->goal_y);
+    } else if (length != expected) {
+        fail("%s: %s path from (%d, %d) to (%d, %d) has %zu cells, BFS has %zu", name, solver, query->start_x,
+            query->start_y, query->goal_x, query->goal_y, length, expected);
+    }
+}
+
+static void check_maze(int width, int height, uint64_t seed, int generator) {
+    const char *solvers[] = { "BFS", "A*", "bitset BFS" };
+    char name[64];
+    Maze *maze = maze_create(width, height);
+    MazeReport report;
+    MazeGraph graph;
+    DirectionField field;
+    PathQuery queries[QUERIES];
+    size_t lengths[QUERIES];
+    PathBatch batch;
+    Arena path_arena = { 0 };
+    Arena search_arena = { 0 };
+    Rng rng;
+
+    snprintf(name, sizeof(name), "%s %dx%d seed %llu", generator == GENERATOR_ELLER ? "eller" : "recursive",
+        width, height, (unsigned long long) seed);
+
+    if (maze == NULL) {
+        fail("%s: not enough memory", name);
+        return;
+    }
+
+    if (generator == GENERATOR_ELLER) {
+        generate_maze_eller(maze, seed);
+    } else {
+        generate_maze(maze, seed, 0);
+    }
+
+    if (!validate_maze(maze, 0, &report)) {
+        fail("%s: not enough memory to validate", name);
+    } else if (!report.perfect) {
+        fail("%s: not perfect, %zu components, %zu cycles", name, report.components, report.cycles);
+    }
+
+    // The entrance to the exit first, then random pairs
+    rng_init(&rng, seed);
+    queries[0] = (PathQuery) { 0, 0, width - 1, height - 1 };
+
+    for (int i = 1; i < QUERIES; i++) {
+        queries[i] = (PathQuery) { rng_below(&rng, width), rng_below(&rng, height), rng_below(&rng, width),
+            rng_below(&rng, height) };
+    }
+
+    for (int i = 0; i < QUERIES; i++) {
+        PathQuery *query = &queries[i];
+        // BFS on the heap sets the length every other solver has to match
+        MazePath path = { 0 };
+        int found = solve_maze(maze, query->start_x, query->start_y, query->goal_x, query->goal_y, SOLVER_BFS, &path);
+        lengths[i] = path.length;
+        check_path(name, solvers[SOLVER_BFS], maze, query, found, path.cells, path.length, lengths[i]);
+        maze_path_free(&path);
+
+        for (int method = SOLVER_ASTAR; method <= SOLVER_BITSET; method++) {
+            path = (MazePath) { 0 };
+            found = solve_maze(maze, query->start_x, query->start_y, query->goal_x, query->goal_y, method, &path);
+            check_path(name, solvers[method], maze, query, found, path.cells, path.length, lengths[i]);
+            maze_path_free(&path);
+
+            // The same search with its memory in arenas
+            path = (MazePath) { .arena = &path_arena, .scratch = &search_arena };
+            found = solve_maze(maze, query->start_x, query->start_y, query->goal_x, query->goal_y, method, &path);
+            check_path(name, solvers[method], maze, query, found, path.cells, path.length, lengths[i]);
+            maze_path_free(&path);
+            arena_reset(&path_arena);
+        }
+    }
+
+    if (report.solution_length != (long) lengths[0]) {
+        fail("%s: the validator's solution has %ld cells, BFS has %zu", name, report.solution_length, lengths[0]);
+    }
+
+    if (!build_maze_graph(maze, &graph)) {
+        fail("%s: not enough memory for the junction graph", name);
+    } else {
+        for (int i = 0; i < QUERIES; i++) {
+            PathQuery *query = &queries[i];
+            MazePath path = { 0 };
+            int found = solve_maze_graph(&graph, query->start_x, query->start_y, query->goal_x, query->goal_y, &path);
+
+            check_path(name, "junction graph", maze, query, found, path.cells, path.length, lengths[i]);
+            maze_path_free(&path);
+        }
+
+        if (!solve_path_batch(&graph, queries, QUERIES, 0, &batch)) {
+            fail("%s: not enough memory for a batch", name);
+        } else {
+            for (int i = 0; i < QUERIES; i++) {
+                check_path(name, "path batch", maze, &queries[i], batch.offsets[i + 1] > batch.offsets[i],
+                    batch.cells + batch.offsets[i], batch.offsets[i + 1] - batch.offsets[i], lengths[i]);
+            }
+
+            path_batch_free(&batch);
+        }
+
+        maze_graph_free(&graph);
+    }
+
+    // The field only leads to its goal, the exit
+    if (!build_direction_field(maze, width - 1, height - 1, &field)) {
+        fail("%s: not enough memory for the direction field", name);
+    } else {
+        for (int i = 0; i < QUERIES; i++) {
+            PathQuery query = { queries[i].start_x, queries[i].start_y, width - 1, height - 1 };
+            MazePath path = { 0 };
+            MazePath expected = { 0 };
+            int found = follow_direction_field(&field, query.start_x, query.start_y, &path);
+
+            solve_maze(maze, query.start_x, query.start_y, query.goal_x, query.goal_y, SOLVER_BFS, &expected);
+            check_path(name, "direction field", maze, &query, found, path.cells, path.length, expected.length);
+            maze_path_free(&path);
+            maze_path_free(&expected);
+        }
+
+        direction_field_free(&field);
+    }
+
+    arena_free(&path_arena);
+    arena_free(&search_arena);
+    maze_free(maze);
+}
+
+int main() {
+    // Widths on both sides of the 64 cells of a word
+    const int sizes[][2] = { { 1, 1 }, { 1, 40 }, { 40, 1 }, { 63, 17 }, { 64, 64 }, { 65, 30 }, { 130, 90 },
+        { 300, 200 } };
+    int checked = 0;
+
+    for (size_t size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+        for (uint64_t seed = 1; seed <= 3; seed++) {
+            for (int generator = GENERATOR_RECURSIVE; generator <= GENERATOR_ELLER; generator++) {
+                check_maze(sizes[size][0], sizes[size][1], seed, generator);
+                checked++;
+            }
+        }
+    }
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("All checks passed on %d mazes\n", checked);
+    return 0;
+}
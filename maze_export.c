@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "maze_export.h"
+
+#define OUTPUT_BLOCK_BYTES (1 << 20)
+
+static int output_open(OutputBuffer *output, FILE *file, size_t line_bytes) {
+    output->file = file;
+    output->used = 0;
+    output->failed = 0;
+
+    // Always room for at least two lines
+    output->capacity = OUTPUT_BLOCK_BYTES;
+
+    if (output->capacity < 2 * line_bytes) {
+        output->capacity = 2 * line_bytes;
+    }
+
+    output->data = malloc(output->capacity);
+
+    return output->data != NULL;
+}
+
+static int output_flush(OutputBuffer *output) {
+    if (output->used > 0 && !output->failed &&
+        fwrite(output->data, 1, output->used, output->file) != output->used) {
+        output->failed = 1;
+    }
+
+    output->used = 0;
+
+    return !output->failed;
+}
+
+// Returns space for the next bytes, flushing the block first if it is full
+static char *output_reserve(OutputBuffer *output, size_t bytes) {
+    if (output->used + bytes > output->capacity) {
+        output_flush(output);
+    }
+
+    return output->data + output->used;
+}
+
+static int output_close(OutputBuffer *output) {
+    int ok = output_flush(output) && fflush(output->file) == 0;
+
+    free(output->data);
+    output->data = NULL;
+
+    return ok;
+}
+
+int ascii_writer_open(AsciiWriter *writer, FILE *file, int width) {
+    writer->width = width;
+
+    return output_open(&writer->output, file, 4 * (size_t) width + 2);
+}
+
+// Same text as the original printf version, built four characters at a time
+int write_ascii_row(const MazeRow *row, void *context) {
+    AsciiWriter *writer = context;
+    int width = row->width;
+    size_t line_bytes = 4 * (size_t) width + 2;
+    char *line = output_reserve(&writer->output, 2 * line_bytes);
+    char *out = line;
+
+    for (int x = 0; x < width; x++, out += 4) {
+        memcpy(out, maze_get_bit(row->top, x) ? "+---" : "+   ", 4);
+    }
+
+    memcpy(out, "+\n", 2);
+    out += 2;
+
+    // Bottom of maze has no cells
+    if (row->vertical != NULL) {
+        for (int x = 0; x < width; x++, out += 4) {
+            memcpy(out, maze_get_bit(row->vertical, x) ? "|   " : "    ", 4);
+        }
+
+        memcpy(out, maze_get_bit(row->vertical, width) ? "|\n" : " \n", 2);
+        out += 2;
+    }
+
+    writer->output.used += out - line;
+
+    return !writer->output.failed;
+}
+
+int ascii_writer_close(AsciiWriter *writer) {
+    return output_close(&writer->output);
+}
+
+static size_t image_line_bytes(int format, int width) {
+    size_t pixels = 2 * (size_t) width + 1;
+
+    return format == IMAGE_PBM ? (pixels + 7) / 8 : pixels;
+}
+
+// Nibble of wall bits spread to the odd and even pixels of a PBM byte
+static unsigned char odd_pixels[16];
+static unsigned char even_pixels[16];
+
+// Spreads the 4 bits of a nibble to every other bit of a byte, first cell
+// in the most significant position as PBM expects
+static unsigned char spread_nibble(int nibble, int shift) {
+    unsigned char byte = 0;
+
+    for (int i = 0; i < 4; i++) {
+        if (nibble & (1 << i)) {
+            byte |= 1 << (7 - 2 * i - shift);
+        }
+    }
+
+    return byte;
+}
+
+int image_writer_open(ImageWriter *writer, FILE *file, int format, int width, int height) {
+    writer->format = format;
+    writer->width = width;
+
+    for (int n = 0; n < 16; n++) {
+        odd_pixels[n] = spread_nibble(n, 1);
+        even_pixels[n] = spread_nibble(n, 0);
+    }
+
+    if (!output_open(&writer->output, file, image_line_bytes(format, width))) {
+        return 0;
+    }
+
+    char *header = output_reserve(&writer->output, 64);
+    writer->output.used += sprintf(header, format == IMAGE_PBM ? "P4\n%d %d\n" : "P5\n%d %d\n255\n",
+        2 * width + 1, 2 * height + 1);
+
+    return 1;
+}
+
+// Packs one line of pixels: every even pixel is a post (always a wall in
+// the wall row, never in the cell row) and pixel 2x + 1 is bit x of bits.
+// In the cell row the even pixels carry the vertical walls instead.
+static void write_pbm_line(unsigned char *out, const uint64_t *bits, int width, int wall_row) {
+    int pixels = 2 * width + 1;
+    int full_bytes = pixels / 8;
+
+    // Each byte covers four cells
+    for (int i = 0; i < full_bytes; i++) {
+        int nibble = (bits[i >> 4] >> ((i & 15) * 4)) & 15;
+        out[i] = wall_row ? 0xAA | odd_pixels[nibble] : even_pixels[nibble];
+    }
+
+    // Remaining pixels of the last partial byte
+    if (pixels % 8 != 0) {
+        unsigned char byte = 0;
+
+        for (int p = full_bytes * 8; p < pixels; p++) {
+            int x = p / 2;
+            int black = wall_row ? (p % 2 == 0 || maze_get_bit(bits, x)) : (p % 2 == 0 && maze_get_bit(bits, x));
+
+            if (black) {
+                byte |= 1 << (7 - p % 8);
+            }
+        }
+
+        out[full_bytes] = byte;
+    }
+}
+
+static void write_pgm_line(unsigned char *out, const uint64_t *bits, int width, int wall_row) {
+    for (int x = 0; x < width; x++) {
+        int wall = maze_get_bit(bits, x);
+
+        out[2 * x] = wall_row || wall ? 0 : 255;
+        out[2 * x + 1] = wall_row && wall ? 0 : 255;
+    }
+
+    out[2 * width] = wall_row || maze_get_bit(bits, width) ? 0 : 255;
+}
+
+int write_image_row(const MazeRow *row, void *context) {
+    ImageWriter *writer = context;
+    size_t line_bytes = image_line_bytes(writer->format, row->width);
+    unsigned char *out = (unsigned char *) output_reserve(&writer->output, 2 * line_bytes);
+    int lines = row->vertical != NULL ? 2 : 1;
+
+    for (int i = 0; i < lines; i++) {
+        const uint64_t *bits = i == 0 ? row->top : row->vertical;
+
+        if (writer->format == IMAGE_PBM) {
+            write_pbm_line(out + i * line_bytes, bits, row->width, i == 0);
+        } else {
+            write_pgm_line(out + i * line_bytes, bits, row->width, i == 0);
+        }
+    }
+
+    writer->output.used += lines * line_bytes;
+
+    return !writer->output.failed;
+}
+
+int image_writer_close(ImageWriter *writer) {
+    return output_close(&writer->output);
+}
+
+void print_maze(const Maze *maze) {
+    AsciiWriter writer;
+
+    if (ascii_writer_open(&writer, stdout, maze->width)) {
+        for_each_maze_row(maze, write_ascii_row, &writer);
+        ascii_writer_close(&writer);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef MAZE_EXPORT_H
+#define MAZE_EXPORT_H
+
+#include <stdio.h>
+#include "maze_algorithms.h"
+
+#define IMAGE_PBM 0 // 1 bit per pixel, walls are black
+#define IMAGE_PGM 1 // 1 byte per pixel, walls are black
+
+// Collects whole rows and hands them to the file in large blocks
+typedef struct {
+    FILE *file;
+    char *data;
+    size_t used;
+    size_t capacity;
+    int failed;
+} OutputBuffer;
+
+typedef struct {
+    OutputBuffer output;
+    int width;
+} AsciiWriter;
+
+// One pixel per wall unit, the image is (2 * width + 1) x (2 * height + 1)
+typedef struct {
+    OutputBuffer output;
+    int format;
+    int width;
+} ImageWriter;
+
+int ascii_writer_open(AsciiWriter *writer, FILE *file, int width);
+int write_ascii_row(const MazeRow *row, void *writer);
+int ascii_writer_close(AsciiWriter *writer);
+
+int image_writer_open(ImageWriter *writer, FILE *file, int format, int width, int height);
+int write_image_row(const MazeRow *row, void *writer);
+int image_writer_close(ImageWriter *writer);
+
+void print_maze(const Maze *maze);
+
+#endif
@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "maze_file.h"
+#include "rng.h"
+
+#define MAZE_FILE_MAGIC "MAZE"
+#define WRITE_BUFFER_BYTES (1 << 20)
+
+// Order-independent sum of mixed words, so rows can be checksummed as they
+// are written and a file can be verified in any order
+uint64_t maze_checksum(const uint64_t *words, size_t count, size_t first_index) {
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        sum += rng_mix(words[i] + (first_index + i) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    return sum;
+}
+
+static size_t line_stride(int width) {
+    return ((size_t) width + 64) / 64;
+}
+
+static int write_all(int fd, const void *data, size_t bytes, off_t offset) {
+    const char *bytes_left = data;
+
+    while (bytes > 0) {
+        ssize_t written = pwrite(fd, bytes_left, bytes, offset);
+
+        if (written <= 0) {
+            return 0;
+        }
+
+        bytes_left += written;
+        bytes -= written;
+        offset += written;
+    }
+
+    return 1;
+}
+
+int maze_writer_open(MazeWriter *writer, const char *path, int width, int height, uint64_t seed, int generator) {
+    memset(writer, 0, sizeof(MazeWriter));
+    writer->fd = -1;
+
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    size_t stride = line_stride(width);
+    size_t line_bytes = stride * sizeof(uint64_t);
+
+    writer->stride = stride;
+    writer->buffer_lines = WRITE_BUFFER_BYTES / line_bytes;
+
+    if (writer->buffer_lines == 0) {
+        writer->buffer_lines = 1;
+    }
+
+    writer->vertical_buffer = malloc(writer->buffer_lines * line_bytes);
+    writer->horizontal_buffer = malloc(writer->buffer_lines * line_bytes);
+
+    if (writer->vertical_buffer == NULL || writer->horizontal_buffer == NULL) {
+        maze_writer_close(writer);
+        return 0;
+    }
+
+    MazeFileHeader *header = &writer->header;
+    memcpy(header->magic, MAZE_FILE_MAGIC, 4);
+    header->version = MAZE_FILE_VERSION;
+    header->width = width;
+    header->height = height;
+    header->seed = seed;
+    header->generator = generator;
+    header->header_bytes = sizeof(MazeFileHeader);
+    header->data_bytes = line_bytes * (2 * (uint64_t) height + 1);
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (writer->fd < 0) {
+        maze_writer_close(writer);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Writes the buffered lines of one region, lines are always appended in order
+static int flush_lines(MazeWriter *writer, uint64_t *buffer, size_t *count, size_t *written, size_t first_line) {
+    size_t line_bytes = writer->stride * sizeof(uint64_t);
+    off_t offset = writer->header.header_bytes + (first_line + *written) * line_bytes;
+
+    if (*count == 0) {
+        return 1;
+    }
+
+    if (!write_all(writer->fd, buffer, *count * line_bytes, offset)) {
+        return 0;
+    }
+
+    *written += *count;
+    *count = 0;
+
+    return 1;
+}
+
+static int append_line(MazeWriter *writer, const uint64_t *line, uint64_t *buffer, size_t *count, size_t *written, size_t first_line) {
+    size_t stride = writer->stride;
+    size_t index = first_line + *written + *count;
+
+    writer->checksum += maze_checksum(line, stride, index * stride);
+    memcpy(buffer + *count * stride, line, stride * sizeof(uint64_t));
+
+    if (++*count == writer->buffer_lines) {
+        return flush_lines(writer, buffer, count, written, first_line);
+    }
+
+    return 1;
+}
+
+int write_maze_row(const MazeRow *row, void *context) {
+    MazeWriter *writer = context;
+    size_t horizontal_start = writer->header.height;
+
+    if (row->vertical != NULL &&
+        !append_line(writer, row->vertical, writer->vertical_buffer, &writer->vertical_count, &writer->vertical_written, 0)) {
+        return 0;
+    }
+
+    return append_line(writer, row->top, writer->horizontal_buffer, &writer->horizontal_count, &writer->horizontal_written, horizontal_start);
+}
+
+// Flushes the remaining lines and writes the header. Returns 0 if any
+// write failed or the maze was incomplete.
+int maze_writer_close(MazeWriter *writer) {
+    int ok = writer->fd >= 0;
+
+    if (ok) {
+        ok = flush_lines(writer, writer->vertical_buffer, &writer->vertical_count, &writer->vertical_written, 0) &&
+            flush_lines(writer, writer->horizontal_buffer, &writer->horizontal_count, &writer->horizontal_written, writer->header.height) &&
+            writer->vertical_written == writer->header.height &&
+            writer->horizontal_written == (size_t) writer->header.height + 1;
+    }
+
+    if (ok) {
+        writer->header.checksum = writer->checksum;
+        ok = write_all(writer->fd, &writer->header, sizeof(MazeFileHeader), 0);
+    }
+
+    if (writer->fd >= 0 && close(writer->fd) != 0) {
+        ok = 0;
+    }
+
+    free(writer->vertical_buffer);
+    free(writer->horizontal_buffer);
+    writer->vertical_buffer = NULL;
+    writer->horizontal_buffer = NULL;
+    writer->fd = -1;
+
+    return ok;
+}
+
+int maze_write(const Maze *maze, const char *path, uint64_t seed, int generator) {
+    MazeWriter writer;
+
+    if (!maze_writer_open(&writer, path, maze->width, maze->height, seed, generator)) {
+        return 0;
+    }
+
+    int ok = for_each_maze_row(maze, write_maze_row, &writer);
+
+    return maze_writer_close(&writer) && ok;
+}
+
+// Maps a .maze file read-only and points a Maze at the walls inside it,
+// nothing is copied. The checksum is only checked when verify is set since
+// that touches every page.
+Maze *maze_map(const char *path, MazeFileHeader *header, int verify) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        printf("Could not open %s\n", path);
+        return NULL;
+    }
+
+    struct stat info;
+    MazeFileHeader file_header;
+
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(MazeFileHeader) ||
+        pread(fd, &file_header, sizeof(MazeFileHeader), 0) != sizeof(MazeFileHeader)) {
+        printf("%s is not a maze file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t stride = line_stride(file_header.width);
+
+    if (memcmp(file_header.magic, MAZE_FILE_MAGIC, 4) != 0 ||
+        file_header.version != MAZE_FILE_VERSION ||
+        file_header.header_bytes != sizeof(MazeFileHeader) ||
+        file_header.width == 0 || file_header.width > INT_MAX ||
+        file_header.height == 0 || file_header.height > INT_MAX ||
+        file_header.data_bytes != stride * sizeof(uint64_t) * (2 * (uint64_t) file_header.height + 1) ||
+        (uint64_t) info.st_size < file_header.header_bytes + file_header.data_bytes) {
+        printf("%s is not a supported maze file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    size_t mapping_bytes = file_header.header_bytes + file_header.data_bytes;
+    void *mapping = mmap(NULL, mapping_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        printf("Could not map %s\n", path);
+        return NULL;
+    }
+
+    Maze *maze = malloc(sizeof(Maze));
+
+    if (maze == NULL) {
+        munmap(mapping, mapping_bytes);
+        return NULL;
+    }
+
+    maze->width = file_header.width;
+    maze->height = file_header.height;
+    maze->stride = stride;
+    maze->vertical = (uint64_t *) ((char *) mapping + file_header.header_bytes);
+    maze->horizontal = maze->vertical + stride * maze->height;
+    maze->mapping = mapping;
+    maze->mapping_bytes = mapping_bytes;
+
+    if (verify && maze_checksum(maze->vertical, file_header.data_bytes / sizeof(uint64_t), 0) != file_header.checksum) {
+        printf("%s is corrupt, checksum does not match\n", path);
+        maze_free(maze);
+        return NULL;
+    }
+
+    if (header != NULL) {
+        *header = file_header;
+    }
+
+    return maze;
+}
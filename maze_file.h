@@ -0,0 +1,49 @@
+#ifndef MAZE_FILE_H
+#define MAZE_FILE_H
+
+#include <stdint.h>
+#include "maze_algorithms.h"
+
+#define MAZE_FILE_VERSION 1
+
+// On-disk header of a .maze file, in the byte order of the machine that
+// wrote it. It is followed by the vertical and then the horizontal wall
+// lines, laid out exactly as in a Maze, so a mapped file can be used in
+// place. A file from a machine of the other byte order fails the version
+// check on load rather than being converted.
+typedef struct {
+    char magic[4]; // "MAZE"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint64_t seed;
+    uint32_t generator;
+    uint32_t header_bytes;
+    uint64_t data_bytes;
+    uint64_t checksum; // See maze_checksum
+    uint8_t reserved[16];
+} MazeFileHeader;
+
+// Writes rows as they arrive from generate_maze_rows or for_each_maze_row
+typedef struct {
+    int fd;
+    MazeFileHeader header;
+    size_t stride;
+    uint64_t checksum;
+    uint64_t *vertical_buffer;
+    uint64_t *horizontal_buffer;
+    size_t buffer_lines; // Lines each buffer holds
+    size_t vertical_count; // Lines waiting in each buffer
+    size_t horizontal_count;
+    size_t vertical_written; // Lines already on disk
+    size_t horizontal_written;
+} MazeWriter;
+
+uint64_t maze_checksum(const uint64_t *words, size_t count, size_t first_index);
+int maze_writer_open(MazeWriter *writer, const char *path, int width, int height, uint64_t seed, int generator);
+int write_maze_row(const MazeRow *row, void *writer);
+int maze_writer_close(MazeWriter *writer);
+int maze_write(const Maze *maze, const char *path, uint64_t seed, int generator);
+Maze *maze_map(const char *path, MazeFileHeader *header, int verify);
+
+#endif
@@ -0,0 +1,719 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "maze_graph.h"
+
+#define NO_NODE UINT32_MAX
+#define NO_DISTANCE UINT32_MAX
+
+// Queries a batch worker claims at a time
+#define BATCH_CHUNK 16
+
+static const int step_x[4] = { 1, 0, -1, 0 };
+static const int step_y[4] = { 0, 1, 0, -1 };
+
+typedef struct {
+    uint32_t *nodes;
+    size_t count;
+    size_t capacity;
+} NodeBucket;
+
+// Dijkstra frontier. Every queued distance is within max_length of the one
+// being expanded, so max_length + 1 buckets used in a circle are enough.
+typedef struct {
+    NodeBucket *buckets;
+    size_t bucket_count;
+    size_t pending; // Entries in all buckets, stale ones included
+} BucketQueue;
+
+// Where a corridor walk from a cell that is not a node ended
+typedef struct {
+    uint32_t node; // NO_NODE if the walk hit the stop cell or looped
+    int reached_stop;
+    uint32_t length;
+    int direction; // Direction of the first step
+    int arrival; // Direction of the last step
+} CorridorEnd;
+
+// Per-thread search state. Distances stay at NO_DISTANCE between searches
+// and only the nodes a search touched are put back, so one search costs
+// what it explores rather than the size of the graph.
+typedef struct {
+    uint32_t *distance;
+    uint32_t *parent;
+    uint32_t *via; // Edge from the parent, or the first step from the start
+    uint32_t *touched;
+    size_t touched_count;
+    BucketQueue queue;
+    CorridorEnd goal_ends[2];
+    uint32_t best; // Length of the best path found so far
+    int best_end; // Goal end of the best path, -1 for a walk along the start's corridor
+    int direct_direction;
+    size_t expanded;
+    int failed;
+} GraphSearch;
+
+typedef struct BatchWork BatchWork;
+
+typedef struct {
+    BatchWork *work;
+    PathCell *cells; // Paths this thread found, back to back
+    size_t count;
+    size_t capacity;
+    size_t expanded;
+    int failed;
+} BatchOutput;
+
+struct BatchWork {
+    const MazeGraph *graph;
+    const PathQuery *queries;
+    size_t count;
+    size_t next_query; // Claimed atomically by the workers
+    BatchOutput *outputs;
+    int *owners; // Thread that solved each query
+    size_t *lengths;
+    size_t *local_offsets; // Where each path starts in its thread's buffer
+};
+
+static void search_free(GraphSearch *search);
+
+// Cells of one word of a row that have exactly two openings. The four
+// opening masks are added bit-sliced into a 3-bit count per cell.
+static uint64_t corridor_cells(const Maze *maze, int y, size_t word) {
+    const uint64_t *vertical = maze_vertical_line(maze, y);
+    uint64_t next = word + 1 < maze->stride ? vertical[word + 1] : 0;
+    uint64_t valid = maze_word_mask(word, maze->width);
+    uint64_t right_open = ~((vertical[word] >> 1) | (next << 63)) & maze_word_mask(word, maze->width - 1);
+    uint64_t left_open = ~vertical[word] & valid & (word == 0 ? ~(uint64_t) 1 : ~(uint64_t) 0);
+    uint64_t top_open = y > 0 ? ~maze_horizontal_line(maze, y)[word] & valid : 0;
+    uint64_t bottom_open = y < maze->height - 1 ? ~maze_horizontal_line(maze, y + 1)[word] & valid : 0;
+
+    uint64_t sum_lr = left_open ^ right_open;
+    uint64_t carry_lr = left_open & right_open;
+    uint64_t sum_tb = top_open ^ bottom_open;
+    uint64_t carry_tb = top_open & bottom_open;
+    uint64_t carry = sum_lr & sum_tb;
+    uint64_t bit0 = sum_lr ^ sum_tb;
+    uint64_t bit1 = carry_lr ^ carry_tb ^ carry;
+    uint64_t bit2 = carry_lr & carry_tb;
+
+    return valid & ~bit0 & bit1 & ~bit2;
+}
+
+static int is_node_cell(const MazeGraph *graph, int x, int y) {
+    return maze_get_bit(graph->is_node + (size_t) y * graph->maze->stride, x);
+}
+
+static uint32_t node_id(const MazeGraph *graph, int x, int y) {
+    size_t word = (size_t) y * graph->maze->stride + (x >> 6);
+    uint64_t before = graph->is_node[word] & (((uint64_t) 1 << (x & 63)) - 1);
+
+    return graph->node_rank[word] + __builtin_popcountll(before);
+}
+
+// Follows a corridor from (x, y) until it reaches a node, the stop cell or
+// (x, y) again. Returns the number of steps and leaves x, y on the last cell
+// and direction on the last step taken.
+static uint32_t walk_corridor(const MazeGraph *graph, int *x, int *y, int *direction, int stop_x, int stop_y) {
+    int start_x = *x;
+    int start_y = *y;
+    int cx = *x;
+    int cy = *y;
+    int d = *direction;
+    uint32_t length = 0;
+
+    while (1) {
+        cx += step_x[d];
+        cy += step_y[d];
+        length++;
+
+        if (is_node_cell(graph, cx, cy) || (cx == stop_x && cy == stop_y) || (cx == start_x && cy == start_y)) {
+            break;
+        }
+
+        // A corridor cell has one opening besides the way in
+        d = __builtin_ctz(maze_open_directions(graph->maze, cx, cy) & ~(1 << ((d + 2) & 3)));
+    }
+
+    *x = cx;
+    *y = cy;
+    *direction = d;
+    return length;
+}
+
+// Writes the cells after (x, y) on a walk of length steps
+static size_t append_corridor(const MazeGraph *graph, int x, int y, int direction, uint32_t length, PathCell *cells) {
+    for (uint32_t i = 0; i < length; i++) {
+        if (i > 0) {
+            direction = __builtin_ctz(maze_open_directions(graph->maze, x, y) & ~(1 << ((direction + 2) & 3)));
+        }
+
+        x += step_x[direction];
+        y += step_y[direction];
+        cells[i] = (PathCell) { x, y };
+    }
+
+    return length;
+}
+
+// Collapses every corridor into one edge. Each corridor is walked once from
+// each end, so building costs two visits per cell.
+int build_maze_graph(const Maze *maze, MazeGraph *graph) {
+    size_t words = (size_t) maze->height * maze->stride;
+
+    memset(graph, 0, sizeof(MazeGraph));
+    graph->maze = maze;
+
+    // Distances along the graph are 32 bits
+    if ((uint64_t) maze->width * maze->height >= NO_DISTANCE) {
+        return 0;
+    }
+
+    graph->is_node = malloc(words * sizeof(uint64_t));
+    graph->node_rank = malloc(words * sizeof(uint32_t));
+
+    if (graph->is_node == NULL || graph->node_rank == NULL) {
+        goto failed;
+    }
+
+    size_t nodes = 0;
+
+    for (int y = 0; y < maze->height; y++) {
+        uint64_t *line = graph->is_node + (size_t) y * maze->stride;
+
+        for (size_t word = 0; word < maze->stride; word++) {
+            line[word] = maze_word_mask(word, maze->width) & ~corridor_cells(maze, y, word);
+        }
+    }
+
+    maze_set_bit(graph->is_node, 0, 1);
+    maze_set_bit(graph->is_node + (size_t) (maze->height - 1) * maze->stride, maze->width - 1, 1);
+
+    for (size_t word = 0; word < words; word++) {
+        graph->node_rank[word] = nodes;
+        nodes += __builtin_popcountll(graph->is_node[word]);
+
+        if (nodes >= NO_NODE) {
+            goto failed;
+        }
+    }
+
+    graph->node_count = nodes;
+    graph->node_cells = malloc(nodes * sizeof(uint64_t));
+    graph->edge_offsets = malloc((nodes + 1) * sizeof(size_t));
+
+    if (graph->node_cells == NULL || graph->edge_offsets == NULL) {
+        goto failed;
+    }
+
+    // Size the edge lists from the openings of each node
+    size_t node = 0;
+    size_t edges = 0;
+
+    for (size_t word = 0; word < words; word++) {
+        for (uint64_t bits = graph->is_node[word]; bits; bits &= bits - 1) {
+            int y = word / maze->stride;
+            int x = (word % maze->stride) * 64 + __builtin_ctzll(bits);
+
+            graph->node_cells[node] = (uint64_t) y * maze->width + x;
+            graph->edge_offsets[node++] = edges;
+            edges += __builtin_popcount(maze_open_directions(maze, x, y));
+        }
+    }
+
+    if (edges >= NO_NODE) {
+        goto failed;
+    }
+
+    graph->edge_offsets[nodes] = edges;
+    graph->edge_count = edges;
+    graph->edges = malloc(edges * sizeof(GraphEdge));
+
+    if (graph->edges == NULL) {
+        goto failed;
+    }
+
+    for (node = 0; node < nodes; node++) {
+        int x = graph->node_cells[node] % maze->width;
+        int y = graph->node_cells[node] / maze->width;
+        GraphEdge *edge = graph->edges + graph->edge_offsets[node];
+
+        for (int open = maze_open_directions(maze, x, y); open; open &= open - 1) {
+            int direction = __builtin_ctz(open);
+            int end_x = x;
+            int end_y = y;
+            int last = direction;
+            uint32_t length = walk_corridor(graph, &end_x, &end_y, &last, -1, -1);
+
+            *edge++ = (GraphEdge) { node_id(graph, end_x, end_y), length, direction };
+
+            if (length > graph->max_length) {
+                graph->max_length = length;
+            }
+        }
+    }
+
+    return 1;
+
+failed:
+    maze_graph_free(graph);
+    return 0;
+}
+
+void maze_graph_free(MazeGraph *graph) {
+    free(graph->node_cells);
+    free(graph->edge_offsets);
+    free(graph->edges);
+    free(graph->is_node);
+    free(graph->node_rank);
+    memset(graph, 0, sizeof(MazeGraph));
+}
+
+static int bucket_push(BucketQueue *queue, uint32_t distance, uint32_t node) {
+    NodeBucket *bucket = &queue->buckets[distance % queue->bucket_count];
+
+    if (bucket->count == bucket->capacity) {
+        size_t capacity = bucket->capacity ? bucket->capacity * 2 : 16;
+        uint32_t *nodes = realloc(bucket->nodes, capacity * sizeof(uint32_t));
+
+        if (nodes == NULL) {
+            return 0;
+        }
+
+        bucket->nodes = nodes;
+        bucket->capacity = capacity;
+    }
+
+    bucket->nodes[bucket->count++] = node;
+    queue->pending++;
+    return 1;
+}
+
+// Nodes at either end of the corridor through (x, y), or (x, y) itself
+static int corridor_ends(const MazeGraph *graph, int x, int y, int stop_x, int stop_y, CorridorEnd ends[2]) {
+    if (is_node_cell(graph, x, y)) {
+        ends[0] = (CorridorEnd) { node_id(graph, x, y), 0, 0, 0, 0 };
+        return 1;
+    }
+
+    int count = 0;
+
+    for (int open = maze_open_directions(graph->maze, x, y); open; open &= open - 1) {
+        int end_x = x;
+        int end_y = y;
+        int direction = __builtin_ctz(open);
+        int last = direction;
+        uint32_t length = walk_corridor(graph, &end_x, &end_y, &last, stop_x, stop_y);
+        uint32_t node = is_node_cell(graph, end_x, end_y) ? node_id(graph, end_x, end_y) : NO_NODE;
+        int reached_stop = node == NO_NODE && end_x == stop_x && end_y == stop_y;
+
+        ends[count++] = (CorridorEnd) { node, reached_stop, length, direction, last };
+    }
+
+    return count;
+}
+
+static int search_init(GraphSearch *search, const MazeGraph *graph) {
+    size_t nodes = graph->node_count;
+
+    memset(search, 0, sizeof(GraphSearch));
+    search->distance = malloc(nodes * sizeof(uint32_t));
+    search->parent = malloc(nodes * sizeof(uint32_t));
+    search->via = malloc(nodes * sizeof(uint32_t));
+    search->touched = malloc(nodes * sizeof(uint32_t));
+    search->queue.bucket_count = graph->max_length + 1;
+    search->queue.buckets = calloc(search->queue.bucket_count, sizeof(NodeBucket));
+
+    if (search->distance == NULL || search->parent == NULL || search->via == NULL || search->touched == NULL ||
+        search->queue.buckets == NULL) {
+        search_free(search);
+        return 0;
+    }
+
+    for (size_t i = 0; i < nodes; i++) {
+        search->distance[i] = NO_DISTANCE;
+    }
+
+    return 1;
+}
+
+static void search_free(GraphSearch *search) {
+    free(search->distance);
+    free(search->parent);
+    free(search->via);
+    free(search->touched);
+
+    for (size_t i = 0; search->queue.buckets != NULL && i < search->queue.bucket_count; i++) {
+        free(search->queue.buckets[i].nodes);
+    }
+
+    free(search->queue.buckets);
+    memset(search, 0, sizeof(GraphSearch));
+}
+
+static int set_distance(GraphSearch *search, uint32_t node, uint32_t distance, uint32_t parent, uint32_t via) {
+    if (search->distance[node] == NO_DISTANCE) {
+        search->touched[search->touched_count++] = node;
+    }
+
+    search->distance[node] = distance;
+    search->parent[node] = parent;
+    search->via[node] = via;
+
+    return bucket_push(&search->queue, distance, node);
+}
+
+// Puts back what the last search changed, in time proportional to it
+static void search_reset(GraphSearch *search) {
+    for (size_t i = 0; i < search->touched_count; i++) {
+        search->distance[search->touched[i]] = NO_DISTANCE;
+    }
+
+    search->touched_count = 0;
+
+    if (search->queue.pending > 0) {
+        for (size_t i = 0; i < search->queue.bucket_count; i++) {
+            search->queue.buckets[i].count = 0;
+        }
+
+        search->queue.pending = 0;
+    }
+}
+
+// Dijkstra over the junction graph. Start and goal may lie inside
+// corridors, they join the search through the nodes at the corridor ends.
+// Returns 1 and sets best if the goal can be reached.
+static int search_graph(const MazeGraph *graph, GraphSearch *search, const PathQuery *query) {
+    const Maze *maze = graph->maze;
+    uint32_t *distance = search->distance;
+    CorridorEnd start_ends[2];
+    CorridorEnd *goal_ends = search->goal_ends;
+
+    if (query->start_x < 0 || query->start_x >= maze->width || query->start_y < 0 || query->start_y >= maze->height ||
+        query->goal_x < 0 || query->goal_x >= maze->width || query->goal_y < 0 || query->goal_y >= maze->height) {
+        return 0;
+    }
+
+    int start_count = corridor_ends(graph, query->start_x, query->start_y, query->goal_x, query->goal_y, start_ends);
+    int goal_count = corridor_ends(graph, query->goal_x, query->goal_y, -1, -1, goal_ends);
+
+    search->best = query->start_x == query->goal_x && query->start_y == query->goal_y ? 0 : NO_DISTANCE;
+    search->best_end = -1;
+    search->direct_direction = 0;
+
+    for (int i = 0; i < start_count; i++) {
+        CorridorEnd *end = &start_ends[i];
+
+        if (end->reached_stop) {
+            // The goal is further along the start's corridor
+            if (end->length < search->best) {
+                search->best = end->length;
+                search->direct_direction = end->direction;
+            }
+        } else if (end->node != NO_NODE && end->length < distance[end->node]) {
+            if (!set_distance(search, end->node, end->length, NO_NODE, end->direction)) {
+                search->failed = 1;
+                return 0;
+            }
+        }
+    }
+
+    BucketQueue *queue = &search->queue;
+
+    for (uint32_t d = 0; queue->pending > 0 && d < search->best; d++) {
+        NodeBucket *bucket = &queue->buckets[d % queue->bucket_count];
+
+        // Edges are shorter than the circle, so nothing found here lands in this bucket
+        while (bucket->count > 0) {
+            uint32_t node = bucket->nodes[--bucket->count];
+            queue->pending--;
+
+            if (distance[node] != d) {
+                continue;
+            }
+
+            search->expanded++;
+
+            for (int i = 0; i < goal_count; i++) {
+                if (goal_ends[i].node == node && d + goal_ends[i].length < search->best) {
+                    search->best = d + goal_ends[i].length;
+                    search->best_end = i;
+                }
+            }
+
+            for (size_t e = graph->edge_offsets[node]; e < graph->edge_offsets[node + 1]; e++) {
+                const GraphEdge *edge = &graph->edges[e];
+                uint32_t next = d + edge->length;
+                uint32_t target = edge->target;
+
+                // A dead end leads nowhere unless the goal is behind it
+                if (graph->edge_offsets[target + 1] - graph->edge_offsets[target] == 1 &&
+                    target != goal_ends[0].node && target != goal_ends[goal_count - 1].node) {
+                    continue;
+                }
+
+                if (next < distance[target] && !set_distance(search, target, next, node, e)) {
+                    search->failed = 1;
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return search->best != NO_DISTANCE;
+}
+
+// Writes the best + 1 cells of the path the last search found
+static void write_graph_path(const MazeGraph *graph, const GraphSearch *search, const PathQuery *query,
+                             PathCell *cells) {
+    const Maze *maze = graph->maze;
+    PathCell *cell = cells + 1;
+
+    cells[0] = (PathCell) { query->start_x, query->start_y };
+
+    if (search->best_end < 0) {
+        append_corridor(graph, query->start_x, query->start_y, search->direct_direction, search->best, cell);
+        return;
+    }
+
+    // A cell's place in the path is its distance from the start, so each
+    // corridor can be written while following the parents back
+    const CorridorEnd *end = &search->goal_ends[search->best_end];
+
+    for (uint32_t node = end->node; node != NO_NODE; node = search->parent[node]) {
+        uint32_t from = search->parent[node];
+
+        if (from == NO_NODE) {
+            append_corridor(graph, query->start_x, query->start_y, search->via[node], search->distance[node], cell);
+        } else {
+            const GraphEdge *edge = &graph->edges[search->via[node]];
+            uint64_t from_cell = graph->node_cells[from];
+
+            append_corridor(graph, from_cell % maze->width, from_cell / maze->width, edge->direction, edge->length,
+                cell + search->distance[from]);
+        }
+    }
+
+    // Walk back into the goal's corridor from its end node
+    uint64_t end_cell = graph->node_cells[end->node];
+
+    append_corridor(graph, end_cell % maze->width, end_cell / maze->width, (end->arrival + 2) & 3, end->length,
+        cell + search->distance[end->node]);
+}
+
+int solve_maze_graph(const MazeGraph *graph, int start_x, int start_y, int goal_x, int goal_y, MazePath *path) {
+    PathQuery query = { start_x, start_y, goal_x, goal_y };
+    GraphSearch search;
+    int found = 0;
+
+    path->cells = NULL;
+    path->length = 0;
+    path->segments = NULL;
+    path->segment_count = 0;
+    path->expanded = 0;
+
+    if (graph->edges == NULL || !search_init(&search, graph)) {
+        return 0;
+    }
+
+    if (search_graph(graph, &search, &query)) {
+        if (maze_path_alloc(path, (size_t) search.best + 1) != NULL) {
+            write_graph_path(graph, &search, &query, path->cells);
+            path->length = (size_t) search.best + 1;
+            found = 1;
+        }
+    }
+
+    path->expanded = search.expanded;
+    search_free(&search);
+    return found;
+}
+
+static int append_cells(BatchOutput *output, size_t count) {
+    if (output->count + count > output->capacity) {
+        size_t capacity = output->capacity ? output->capacity : 4096;
+
+        while (capacity < output->count + count) {
+            capacity *= 2;
+        }
+
+        PathCell *cells = realloc(output->cells, capacity * sizeof(PathCell));
+
+        if (cells == NULL) {
+            return 0;
+        }
+
+        output->cells = cells;
+        output->capacity = capacity;
+    }
+
+    output->count += count;
+    return 1;
+}
+
+// Claims queries a chunk at a time and writes their paths to its own buffer
+static void *batch_worker(void *arg) {
+    BatchOutput *output = arg;
+    BatchWork *work = output->work;
+    GraphSearch search;
+
+    if (!search_init(&search, work->graph)) {
+        output->failed = 1;
+        return NULL;
+    }
+
+    while (1) {
+        size_t first = __atomic_fetch_add(&work->next_query, BATCH_CHUNK, __ATOMIC_RELAXED);
+
+        if (first >= work->count) {
+            break;
+        }
+
+        size_t last = first + BATCH_CHUNK < work->count ? first + BATCH_CHUNK : work->count;
+
+        for (size_t q = first; q < last; q++) {
+            const PathQuery *query = &work->queries[q];
+
+            work->owners[q] = output - work->outputs;
+            work->lengths[q] = 0;
+            work->local_offsets[q] = 0;
+
+            if (!search_graph(work->graph, &search, query)) {
+                search_reset(&search);
+                continue;
+            }
+
+            size_t length = (size_t) search.best + 1;
+            size_t offset = output->count;
+
+            if (!append_cells(output, length)) {
+                output->failed = 1;
+                search_reset(&search);
+                continue;
+            }
+
+            write_graph_path(work->graph, &search, query, output->cells + offset);
+            work->local_offsets[q] = offset;
+            work->lengths[q] = length;
+            search_reset(&search);
+        }
+    }
+
+    output->failed |= search.failed;
+    output->expanded = search.expanded;
+    search_free(&search);
+    return NULL;
+}
+
+// Solves every query in parallel. Path i is cells[offsets[i]] up to
+// cells[offsets[i + 1]] and is empty if the goal cannot be reached.
+int solve_path_batch(const MazeGraph *graph, const PathQuery *queries, size_t count, int threads, PathBatch *batch) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    memset(batch, 0, sizeof(PathBatch));
+    batch->count = count;
+
+    if (threads < 1) {
+        threads = default_thread_count();
+    }
+
+    if ((size_t) threads > (count + BATCH_CHUNK - 1) / BATCH_CHUNK) {
+        threads = (count + BATCH_CHUNK - 1) / BATCH_CHUNK;
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    BatchWork work = { graph, queries, count, 0, NULL, NULL, NULL, NULL };
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    work.outputs = calloc(threads, sizeof(BatchOutput));
+    work.owners = malloc(count * sizeof(int));
+    work.lengths = malloc(count * sizeof(size_t));
+    work.local_offsets = malloc(count * sizeof(size_t));
+    batch->offsets = malloc((count + 1) * sizeof(size_t));
+    // An empty batch may get NULL for the arrays sized by count
+    int ok = graph->edges != NULL && workers != NULL && work.outputs != NULL && batch->offsets != NULL &&
+        ((work.owners != NULL && work.lengths != NULL && work.local_offsets != NULL) || count == 0);
+    int started = 0;
+
+    for (int i = 0; ok && i < threads; i++) {
+        work.outputs[i].work = &work;
+
+        if (i > 0 && pthread_create(&workers[i], NULL, batch_worker, &work.outputs[i]) != 0) {
+            break;
+        }
+
+        started++;
+    }
+
+    if (started > 0) {
+        batch_worker(&work.outputs[0]);
+    }
+
+    for (int i = 1; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    for (int i = 0; i < started; i++) {
+        ok = ok && !work.outputs[i].failed;
+        batch->expanded += work.outputs[i].expanded;
+    }
+
+    // Pack the per-thread buffers into one, in query order
+    size_t total = 0;
+
+    for (size_t q = 0; ok && q < count; q++) {
+        batch->offsets[q] = total;
+        total += work.lengths[q];
+        batch->solved += work.lengths[q] > 0;
+    }
+
+    if (ok) {
+        batch->offsets[count] = total;
+        batch->cells = malloc(total * sizeof(PathCell));
+        ok = batch->cells != NULL || total == 0;
+    }
+
+    for (size_t q = 0; ok && q < count; q++) {
+        const BatchOutput *output = &work.outputs[work.owners[q]];
+
+        if (work.lengths[q] == 0) {
+            continue;
+        }
+
+        memcpy(batch->cells + batch->offsets[q], output->cells + work.local_offsets[q],
+            work.lengths[q] * sizeof(PathCell));
+    }
+
+    for (int i = 0; work.outputs != NULL && i < threads; i++) {
+        free(work.outputs[i].cells);
+    }
+
+    free(workers);
+    free(work.outputs);
+    free(work.owners);
+    free(work.lengths);
+    free(work.local_offsets);
+
+    if (!ok) {
+        path_batch_free(batch);
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    batch->seconds = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+    batch->threads = started;
+
+    return 1;
+}
+
+void path_batch_free(PathBatch *batch) {
+    free(batch->cells);
+    free(batch->offsets);
+    batch->cells = NULL;
+    batch->offsets = NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef MAZE_GRAPH_H
+#define MAZE_GRAPH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "maze_algorithms.h"
+#include "maze_solver.h"
+
+// A corridor between two nodes. Its cells are recovered by walking from
+// the source node in direction, a corridor never branches.
+typedef struct {
+    uint32_t target;
+    uint32_t length; // Steps from the source node to the target
+    uint32_t direction;
+} GraphEdge;
+
+// Junction graph of a maze. Nodes are the cells that do not have exactly
+// two openings, plus the entrance and exit, all other cells are corridor.
+typedef struct {
+    const Maze *maze;
+    size_t node_count;
+    size_t edge_count;
+    uint64_t *node_cells; // Cell index of each node, in row order
+    size_t *edge_offsets; // Edges of node i are edge_offsets[i] to edge_offsets[i + 1]
+    GraphEdge *edges;
+    uint32_t max_length; // Longest corridor
+    uint64_t *is_node; // One bit per cell, laid out like the lines of the maze
+    uint32_t *node_rank; // Nodes before each word of is_node
+} MazeGraph;
+
+typedef struct {
+    int start_x;
+    int start_y;
+    int goal_x;
+    int goal_y;
+} PathQuery;
+
+// Paths of a batch of queries packed into one buffer
+typedef struct {
+    PathCell *cells;
+    size_t *offsets; // Path i is cells[offsets[i]] to cells[offsets[i + 1]]
+    size_t count;
+    size_t solved; // Queries with a path
+    size_t expanded; // Nodes taken off the frontier over all queries
+    int threads;
+    double seconds;
+} PathBatch;
+
+int build_maze_graph(const Maze *maze, MazeGraph *graph);
+void maze_graph_free(MazeGraph *graph);
+int solve_maze_graph(const MazeGraph *graph, int start_x, int start_y, int goal_x, int goal_y, MazePath *path);
+int solve_path_batch(const MazeGraph *graph, const PathQuery *queries, size_t count, int threads, PathBatch *batch);
+void path_batch_free(PathBatch *batch);
+
+#endif
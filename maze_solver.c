@@ -0,0 +1,678 @@
+#include <stdlib.h>
+#include <string.h>
+#include "maze_solver.h"
+
+// Parents are packed 2 bits per cell and hold the direction each cell was
+// entered from, the start cell has none and is recognised by position.
+
+// Goal of a search that floods every reachable cell
+#define NO_GOAL UINT64_MAX
+
+typedef struct {
+    uint64_t *cells;
+    size_t head;
+    size_t count;
+    size_t capacity; // Power of two
+} CellQueue;
+
+// One word of a bitset laid out like the lines of the maze
+typedef struct {
+    size_t index;
+    uint64_t bits;
+} SetWord;
+
+typedef struct {
+    SetWord *words;
+    size_t count;
+    size_t capacity;
+} SetWordList;
+
+// One direction of the bidirectional search. Levels are only kept modulo 3
+// in two bit planes, which is enough to walk back: a neighbour of a cell at
+// level k is at k - 1, k or k + 1.
+typedef struct {
+    uint64_t *visited;
+    uint64_t *level_low;
+    uint64_t *level_high;
+    SetWordList frontier; // Cells first reached at the current level
+    SetWordList next;
+    uint32_t level;
+    Arena *arena; // Holds all of the above when set, the path's scratch arena
+} BitSearch;
+
+// Cells waiting for A*, each stored with the direction it was entered from
+typedef struct {
+    uint64_t *entries;
+    size_t count;
+    size_t capacity;
+} CellStack;
+
+static int test_and_set(uint64_t *visited, uint64_t cell) {
+    uint64_t mask = (uint64_t) 1 << (cell & 63);
+    int was_set = (visited[cell >> 6] & mask) != 0;
+
+    visited[cell >> 6] |= mask;
+    return was_set;
+}
+
+static int get_parent(const uint64_t *parent, uint64_t cell) {
+    return (parent[cell >> 5] >> ((cell & 31) * 2)) & 3;
+}
+
+// Parents start zeroed and each cell's is set once
+static void set_parent(uint64_t *parent, uint64_t cell, int direction) {
+    parent[cell >> 5] |= (uint64_t) direction << ((cell & 31) * 2);
+}
+
+static size_t parent_words(uint64_t cells) {
+    return (cells + 31) / 32;
+}
+
+static int queue_push(CellQueue *queue, uint64_t cell) {
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 1024;
+        uint64_t *cells = realloc(queue->cells, capacity * sizeof(uint64_t));
+
+        if (cells == NULL) {
+            return 0;
+        }
+
+        // Unwrap the part that had wrapped around to the front
+        size_t wrapped = queue->head + queue->count > queue->capacity ?
+            queue->head + queue->count - queue->capacity : 0;
+        memcpy(cells + queue->capacity, cells, wrapped * sizeof(uint64_t));
+
+        queue->cells = cells;
+        queue->capacity = capacity;
+    }
+
+    queue->cells[(queue->head + queue->count) & (queue->capacity - 1)] = cell;
+    queue->count++;
+    return 1;
+}
+
+static uint64_t queue_pop(CellQueue *queue) {
+    uint64_t cell = queue->cells[queue->head];
+
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+    queue->count--;
+    return cell;
+}
+
+static int stack_push(CellStack *stack, uint64_t entry) {
+    if (stack->count == stack->capacity) {
+        size_t capacity = stack->capacity ? stack->capacity * 2 : 1024;
+        uint64_t *entries = realloc(stack->entries, capacity * sizeof(uint64_t));
+
+        if (entries == NULL) {
+            return 0;
+        }
+
+        stack->entries = entries;
+        stack->capacity = capacity;
+    }
+
+    stack->entries[stack->count++] = entry;
+    return 1;
+}
+
+// Visited is set when a cell is queued, so its parent is final right away.
+// Returns 1 once the goal is reached, or with NO_GOAL once every reachable
+// cell has been searched.
+static int search_bfs(const Maze *maze, uint64_t start, uint64_t goal, uint64_t *visited, uint64_t *parent,
+                      size_t *expanded) {
+    int width = maze->width;
+    CellQueue queue = { NULL, 0, 0, 0 };
+    int found = 0;
+
+    test_and_set(visited, start);
+
+    if (!queue_push(&queue, start)) {
+        return 0;
+    }
+
+    while (queue.count > 0) {
+        uint64_t cell = queue_pop(&queue);
+        (*expanded)++;
+
+        if (cell == goal) {
+            found = 1;
+            goto done;
+        }
+
+        int x = cell % width;
+        int y = cell / width;
+
+        for (int open = maze_open_directions(maze, x, y); open; open &= open - 1) {
+            int direction = __builtin_ctz(open);
+            uint64_t next = maze_step_cell(cell, width, direction);
+
+            if (test_and_set(visited, next)) {
+                continue;
+            }
+
+            set_parent(parent, next, direction);
+
+            if (!queue_push(&queue, next)) {
+                goto done;
+            }
+        }
+    }
+
+    found = goal == NO_GOAL;
+
+done:
+    free(queue.cells);
+    return found;
+}
+
+// Visited is set when a cell is expanded. Every step changes the Manhattan
+// distance by one, so a neighbour's f is either the current f or f + 2 and
+// two stacks replace the priority queue. Popping the newest entry first
+// follows the deepest path among equal f.
+static int search_astar(const Maze *maze, uint64_t start, uint64_t goal, uint64_t *visited, uint64_t *parent,
+                        size_t *expanded) {
+    int width = maze->width;
+    int goal_x = goal % width;
+    int goal_y = goal / width;
+    CellStack current = { NULL, 0, 0 }; // Entries with the lowest f
+    CellStack later = { NULL, 0, 0 }; // Entries with f + 2
+    int found = 0;
+
+    if (!stack_push(&current, start << 2)) {
+        return 0;
+    }
+
+    while (current.count > 0) {
+        uint64_t entry = current.entries[--current.count];
+        uint64_t cell = entry >> 2;
+
+        if (!test_and_set(visited, cell)) {
+            if (cell != start) {
+                set_parent(parent, cell, entry & 3);
+            }
+
+            (*expanded)++;
+
+            if (cell == goal) {
+                found = 1;
+                break;
+            }
+
+            int x = cell % width;
+            int y = cell / width;
+
+            for (int open = maze_open_directions(maze, x, y); open; open &= open - 1) {
+                int direction = __builtin_ctz(open);
+                uint64_t next = maze_step_cell(cell, width, direction);
+                uint64_t mask = (uint64_t) 1 << (next & 63);
+
+                if (visited[next >> 6] & mask) {
+                    continue;
+                }
+
+                // Moving towards the goal keeps f, moving away raises it by 2
+                int closer = (direction == 0 && x < goal_x) || (direction == 1 && y < goal_y) ||
+                    (direction == 2 && x > goal_x) || (direction == 3 && y > goal_y);
+
+                if (!stack_push(closer ? &current : &later, next << 2 | direction)) {
+                    goto done;
+                }
+            }
+        }
+
+        if (current.count == 0) {
+            CellStack swap = current;
+            current = later;
+            later = swap;
+        }
+    }
+
+done:
+    free(current.entries);
+    free(later.entries);
+    return found;
+}
+
+// Walks parents from a cell back to the root of the search. The path runs
+// from the root when reverse is set and towards it otherwise.
+static int trace_path(const uint64_t *parent, int width, uint64_t from, uint64_t root, int reverse, MazePath *path) {
+    size_t length = 1;
+
+    // Walk once to size the path, then again to fill it
+    for (uint64_t cell = from; cell != root; length++) {
+        cell = maze_step_cell(cell, width, (get_parent(parent, cell) + 2) & 3);
+    }
+
+    if (maze_path_alloc(path, length) == NULL) {
+        return 0;
+    }
+
+    path->length = length;
+    uint64_t cell = from;
+
+    for (size_t i = 0; i < length; i++) {
+        path->cells[reverse ? length - 1 - i : i] = (PathCell) { cell % width, cell / width };
+
+        if (cell != root) {
+            cell = maze_step_cell(cell, width, (get_parent(parent, cell) + 2) & 3);
+        }
+    }
+
+    return 1;
+}
+
+static void *scratch_calloc(const MazePath *path, size_t count, size_t size) {
+    return path->scratch != NULL ? arena_calloc(path->scratch, count, size) : calloc(count, size);
+}
+
+static void scratch_free(const MazePath *path, void *memory) {
+    if (path->scratch == NULL) {
+        free(memory);
+    }
+}
+
+// Arena memory cannot grow in place, the old words stay until the reset
+static int push_set_word(SetWordList *list, Arena *arena, size_t index, uint64_t bits) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        SetWord *words;
+
+        if (arena != NULL) {
+            if ((words = arena_alloc(arena, capacity * sizeof(SetWord))) != NULL && list->count > 0) {
+                memcpy(words, list->words, list->count * sizeof(SetWord));
+            }
+        } else {
+            words = realloc(list->words, capacity * sizeof(SetWord));
+        }
+
+        if (words == NULL) {
+            return 0;
+        }
+
+        list->words = words;
+        list->capacity = capacity;
+    }
+
+    list->words[list->count++] = (SetWord) { index, bits };
+    return 1;
+}
+
+static int level_of(const BitSearch *search, size_t index, int bit) {
+    return ((search->level_low[index] >> bit) & 1) | (((search->level_high[index] >> bit) & 1) << 1);
+}
+
+// Marks the cells of a word that are new to the search as reached on its
+// current level. A word can be listed more than once, with disjoint bits.
+static int reach(BitSearch *search, size_t index, uint64_t bits, uint64_t low, uint64_t high) {
+    bits &= ~search->visited[index];
+
+    if (bits == 0) {
+        return 1;
+    }
+
+    search->visited[index] |= bits;
+    search->level_low[index] |= bits & low;
+    search->level_high[index] |= bits & high;
+
+    return push_set_word(&search->next, search->arena, index, bits);
+}
+
+// Moves a whole frontier one step. Each word of 64 cells is shifted in the
+// four directions, masked by the walls it would cross.
+static int expand_level(const Maze *maze, BitSearch *search) {
+    size_t stride = maze->stride;
+
+    search->level++;
+    search->next.count = 0;
+
+    uint64_t low = search->level % 3 & 1 ? ~(uint64_t) 0 : 0;
+    uint64_t high = search->level % 3 & 2 ? ~(uint64_t) 0 : 0;
+
+    for (size_t i = 0; i < search->frontier.count; i++) {
+        size_t index = search->frontier.words[i].index;
+        uint64_t bits = search->frontier.words[i].bits;
+        int y = index / stride;
+        size_t word = index % stride;
+        const uint64_t *vertical = maze->vertical + index;
+        uint64_t after = word + 1 < stride ? vertical[1] : ~(uint64_t) 0;
+        uint64_t right = bits & ~((vertical[0] >> 1) | (after << 63)) & maze_word_mask(word, maze->width - 1);
+        uint64_t left = bits & ~vertical[0] & (word == 0 ? ~(uint64_t) 1 : ~(uint64_t) 0);
+        int ok = reach(search, index, (right << 1) | (left >> 1), low, high);
+
+        if (right >> 63) {
+            ok &= reach(search, index + 1, 1, low, high);
+        }
+
+        if (left & 1) {
+            ok &= reach(search, index - 1, (uint64_t) 1 << 63, low, high);
+        }
+
+        if (y < maze->height - 1) {
+            ok &= reach(search, index + stride, bits & ~maze->horizontal[index + stride], low, high);
+        }
+
+        if (y > 0) {
+            ok &= reach(search, index - stride, bits & ~maze->horizontal[index], low, high);
+        }
+
+        if (!ok) {
+            return 0;
+        }
+    }
+
+    SetWordList swap = search->frontier;
+    search->frontier = search->next;
+    search->next = swap;
+    return 1;
+}
+
+// Follows levels down from (x, y) to the root of a search, writing each
+// cell step cells further along
+static void walk_levels(const Maze *maze, const BitSearch *search, int x, int y, uint32_t level, PathCell *cells,
+                        int step) {
+    size_t line_bits = maze->stride * 64;
+
+    for (; level > 0; level--) {
+        for (int open = maze_open_directions(maze, x, y); open; open &= open - 1) {
+            int direction = __builtin_ctz(open);
+            int nx = x + (direction == 0) - (direction == 2);
+            int ny = y + (direction == 1) - (direction == 3);
+            size_t bit = ny * line_bits + nx;
+
+            if (((search->visited[bit >> 6] >> (bit & 63)) & 1) &&
+                level_of(search, bit >> 6, bit & 63) == (int) ((level - 1) % 3)) {
+                x = nx;
+                y = ny;
+                break;
+            }
+        }
+
+        cells += step;
+        *cells = (PathCell) { x, y };
+    }
+}
+
+static int bit_search_init(BitSearch *search, const MazePath *path, size_t words, int x, int y, size_t stride) {
+    size_t bit = y * stride * 64 + x;
+
+    memset(search, 0, sizeof(BitSearch));
+    search->arena = path->scratch;
+    search->visited = scratch_calloc(path, words, sizeof(uint64_t));
+    search->level_low = scratch_calloc(path, words, sizeof(uint64_t));
+    search->level_high = scratch_calloc(path, words, sizeof(uint64_t));
+
+    if (search->visited == NULL || search->level_low == NULL || search->level_high == NULL) {
+        return 0;
+    }
+
+    search->visited[bit >> 6] = (uint64_t) 1 << (bit & 63);
+    return push_set_word(&search->frontier, search->arena, bit >> 6, search->visited[bit >> 6]);
+}
+
+static void bit_search_free(BitSearch *search) {
+    if (search->arena != NULL) {
+        return;
+    }
+
+    free(search->visited);
+    free(search->level_low);
+    free(search->level_high);
+    free(search->frontier.words);
+    free(search->next.words);
+}
+
+// Bidirectional breadth-first search over bitsets. The side with the
+// smaller frontier advances one level at a time until it reaches a cell
+// the other side has seen.
+static int solve_bitset(const Maze *maze, int start_x, int start_y, int goal_x, int goal_y, MazePath *path) {
+    size_t words = (size_t) maze->height * maze->stride;
+    size_t line_bits = maze->stride * 64;
+    BitSearch sides[2]; // From the start and from the goal
+    int found = 0;
+
+    int ready = bit_search_init(&sides[0], path, words, start_x, start_y, maze->stride);
+    ready = bit_search_init(&sides[1], path, words, goal_x, goal_y, maze->stride) && ready;
+
+    if (!ready) {
+        goto done;
+    }
+
+    size_t meet = SIZE_MAX; // Bit of the cell where the sides meet
+    uint32_t meet_levels[2];
+
+    if (start_x == goal_x && start_y == goal_y) {
+        meet = start_y * line_bits + start_x;
+        meet_levels[0] = meet_levels[1] = 0;
+    }
+
+    while (meet == SIZE_MAX && sides[0].frontier.count > 0 && sides[1].frontier.count > 0) {
+        int s = sides[1].frontier.count < sides[0].frontier.count;
+        BitSearch *side = &sides[s];
+        BitSearch *other = &sides[!s];
+
+        if (!expand_level(maze, side)) {
+            goto done;
+        }
+
+        // A cell both sides have seen is at the other side's current level:
+        // had it been reached earlier, the other side would have met this
+        // one on the step before
+        for (size_t i = 0; i < side->frontier.count && meet == SIZE_MAX; i++) {
+            size_t index = side->frontier.words[i].index;
+            uint64_t common = side->frontier.words[i].bits & other->visited[index];
+
+            if (common) {
+                meet = index * 64 + __builtin_ctzll(common);
+                meet_levels[s] = side->level;
+                meet_levels[!s] = other->level;
+            }
+        }
+    }
+
+    for (int s = 0; s < 2; s++) {
+        for (size_t word = 0; word < words; word++) {
+            path->expanded += __builtin_popcountll(sides[s].visited[word]);
+        }
+    }
+
+    if (meet == SIZE_MAX) {
+        goto done;
+    }
+
+    size_t length = (size_t) meet_levels[0] + meet_levels[1] + 1;
+    if (maze_path_alloc(path, length) == NULL) {
+        goto done;
+    }
+
+    int meet_x = meet % line_bits;
+    int meet_y = meet / line_bits;
+    PathCell *middle = path->cells + meet_levels[0];
+
+    *middle = (PathCell) { meet_x, meet_y };
+    walk_levels(maze, &sides[0], meet_x, meet_y, meet_levels[0], middle, -1);
+    walk_levels(maze, &sides[1], meet_x, meet_y, meet_levels[1], middle, 1);
+    path->length = length;
+    found = 1;
+
+done:
+    bit_search_free(&sides[0]);
+    bit_search_free(&sides[1]);
+    return found;
+}
+
+// Breadth-first or A* search, one cell at a time
+static int solve_cells(const Maze *maze, int start_x, int start_y, int goal_x, int goal_y, int method, MazePath *path) {
+    int width = maze->width;
+    uint64_t cells = (uint64_t) width * maze->height;
+    uint64_t start = (uint64_t) start_y * width + start_x;
+    uint64_t goal = (uint64_t) goal_y * width + goal_x;
+    uint64_t *visited = scratch_calloc(path, (cells + 63) / 64, sizeof(uint64_t));
+    uint64_t *parent = scratch_calloc(path, parent_words(cells), sizeof(uint64_t));
+    int found = 0;
+
+    if (visited == NULL || parent == NULL) {
+        goto done;
+    }
+
+    if (method == SOLVER_ASTAR) {
+        found = search_astar(maze, start, goal, visited, parent, &path->expanded);
+    } else {
+        found = search_bfs(maze, start, goal, visited, parent, &path->expanded);
+    }
+
+    if (found) {
+        found = trace_path(parent, width, goal, start, 1, path);
+    }
+
+done:
+    scratch_free(path, visited);
+    scratch_free(path, parent);
+    return found;
+}
+
+// Returns 1 and fills path with the shortest route, 0 if there is none
+int solve_maze(const Maze *maze, int start_x, int start_y, int goal_x, int goal_y, int method, MazePath *path) {
+    int found;
+
+    path->cells = NULL;
+    path->length = 0;
+    path->segments = NULL;
+    path->segment_count = 0;
+    path->expanded = 0;
+
+    if (start_x < 0 || start_x >= maze->width || start_y < 0 || start_y >= maze->height ||
+        goal_x < 0 || goal_x >= maze->width || goal_y < 0 || goal_y >= maze->height) {
+        return 0;
+    }
+
+    if (method == SOLVER_BITSET) {
+        found = solve_bitset(maze, start_x, start_y, goal_x, goal_y, path);
+    } else {
+        found = solve_cells(maze, start_x, start_y, goal_x, goal_y, method, path);
+    }
+
+    // Search memory is a few bits per cell of the maze, give it back now
+    // rather than keep it until the next solve
+    if (path->scratch != NULL) {
+        arena_free(path->scratch);
+    }
+
+    return found;
+}
+
+// Allocates the cells of a path from its arena, or the heap if it has none
+PathCell *maze_path_alloc(MazePath *path, size_t length) {
+    if (path->arena != NULL) {
+        path->cells = arena_alloc(path->arena, length * sizeof(PathCell));
+    } else {
+        path->cells = malloc(length * sizeof(PathCell));
+    }
+
+    return path->cells;
+}
+
+static int step_direction(PathCell from, PathCell to) {
+    if (to.x != from.x) {
+        return to.x > from.x ? 0 : 2;
+    }
+
+    return to.y > from.y ? 1 : 3;
+}
+
+// Compresses the path into straight runs, a new segment starts at each turn
+int maze_path_segments(MazePath *path) {
+    size_t count = 0;
+
+    for (size_t i = 1; i < path->length; i++) {
+        if (i == 1 || step_direction(path->cells[i - 1], path->cells[i]) !=
+            step_direction(path->cells[i - 2], path->cells[i - 1])) {
+            count++;
+        }
+    }
+
+    size_t bytes = (count > 0 ? count : 1) * sizeof(PathSegment);
+
+    path->segments = path->arena != NULL ? arena_alloc(path->arena, bytes) : malloc(bytes);
+    path->segment_count = 0;
+
+    if (path->segments == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 1; i < path->length; i++) {
+        int direction = step_direction(path->cells[i - 1], path->cells[i]);
+        PathSegment *last = path->segments + path->segment_count - 1;
+
+        if (path->segment_count > 0 && last->direction == direction) {
+            last->length++;
+        } else {
+            path->segments[path->segment_count++] = (PathSegment) { direction, 1 };
+        }
+    }
+
+    return 1;
+}
+
+// Cells from an arena stay allocated until the arena is reset
+void maze_path_free(MazePath *path) {
+    if (path->arena == NULL) {
+        free(path->cells);
+        free(path->segments);
+    }
+
+    path->cells = NULL;
+    path->length = 0;
+    path->segments = NULL;
+    path->segment_count = 0;
+}
+
+// Floods the maze once from the goal. Afterwards the parent of every cell
+// points one step closer to the goal, so a solve is a walk along them.
+int build_direction_field(const Maze *maze, int goal_x, int goal_y, DirectionField *field) {
+    uint64_t cells = (uint64_t) maze->width * maze->height;
+    size_t expanded = 0;
+
+    field->width = maze->width;
+    field->height = maze->height;
+    field->goal = (uint64_t) goal_y * maze->width + goal_x;
+    field->reachable = calloc((cells + 63) / 64, sizeof(uint64_t));
+    field->parent = calloc(parent_words(cells), sizeof(uint64_t));
+
+    if (field->reachable == NULL || field->parent == NULL ||
+        !search_bfs(maze, field->goal, NO_GOAL, field->reachable, field->parent, &expanded)) {
+        direction_field_free(field);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Fills path with the route from (x, y) to the field's goal in time
+// proportional to its length
+int follow_direction_field(const DirectionField *field, int x, int y, MazePath *path) {
+    path->cells = NULL;
+    path->length = 0;
+    path->segments = NULL;
+    path->segment_count = 0;
+    path->expanded = 0;
+
+    if (field->parent == NULL || x < 0 || x >= field->width || y < 0 || y >= field->height) {
+        return 0;
+    }
+
+    uint64_t cell = (uint64_t) y * field->width + x;
+
+    if (!((field->reachable[cell >> 6] >> (cell & 63)) & 1)) {
+        return 0;
+    }
+
+    return trace_path(field->parent, field->width, cell, field->goal, 0, path);
+}
+
+void direction_field_free(DirectionField *field) {
+    free(field->reachable);
+    free(field->parent);
+    field->reachable = NULL;
+    field->parent = NULL;
+}
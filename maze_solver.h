@@ -0,0 +1,53 @@
+#ifndef MAZE_SOLVER_H
+#define MAZE_SOLVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "maze_algorithms.h"
+#include "arena.h"
+
+// Search strategies
+#define SOLVER_BFS 0
+#define SOLVER_ASTAR 1
+#define SOLVER_BITSET 2 // Bidirectional BFS over 64-cell words
+
+typedef struct {
+    int x;
+    int y;
+} PathCell;
+
+// Straight run of a path, length cells in one direction
+typedef struct {
+    int direction;
+    int length;
+} PathSegment;
+
+// Shortest path, cells[0] is the start and cells[length - 1] the goal
+typedef struct {
+    PathCell *cells;
+    size_t length;
+    PathSegment *segments; // Filled by maze_path_segments
+    size_t segment_count;
+    size_t expanded; // Cells taken off the frontier while searching
+    Arena *arena; // When set, cells come from here and are released by resetting it
+    Arena *scratch; // When set, search memory comes from here and is freed when the search ends
+} MazePath;
+
+// Next step towards a fixed goal from every cell, 2 bits per cell
+typedef struct {
+    int width;
+    int height;
+    uint64_t goal; // Cell index of the goal
+    uint64_t *reachable; // One bit per cell that can reach the goal
+    uint64_t *parent; // Direction each cell was reached from while flooding
+} DirectionField;
+
+int solve_maze(const Maze *maze, int start_x, int start_y, int goal_x, int goal_y, int method, MazePath *path);
+PathCell *maze_path_alloc(MazePath *path, size_t length);
+int maze_path_segments(MazePath *path);
+void maze_path_free(MazePath *path);
+int build_direction_field(const Maze *maze, int goal_x, int goal_y, DirectionField *field);
+int follow_direction_field(const DirectionField *field, int x, int y, MazePath *path);
+void direction_field_free(DirectionField *field);
+
+#endif
@@ -0,0 +1,633 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "maze_validate.h"
+
+#define CROSSING_RIGHT 0
+#define CROSSING_BOTTOM 1
+#define CROSSING_LEFT 2
+#define CROSSING_TOP 3
+
+typedef struct {
+    uint32_t *labels;
+    size_t count;
+    size_t capacity;
+} LabelList;
+
+// A tile's share of the report. Every passage leaving the tile is listed
+// with the tile-local component it belongs to, in the order it lies along
+// the border, so the two sides of a border line up one to one.
+typedef struct {
+    size_t components;
+    size_t cycles;
+    size_t passages;
+    size_t dead_ends;
+    size_t junctions;
+    size_t branches;
+    uint32_t labels; // Components that leave the tile
+    LabelList crossings[4];
+    int failed;
+} TileResult;
+
+typedef struct {
+    const Maze *maze;
+    int tiles_x;
+    int tiles_y;
+    TileResult *results;
+    int next_tile; // Claimed atomically by the workers
+} TileWork;
+
+static double seconds_since(struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int push_label(LabelList *list, uint32_t label) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        uint32_t *labels = realloc(list->labels, capacity * sizeof(uint32_t));
+
+        if (labels == NULL) {
+            return 0;
+        }
+
+        list->labels = labels;
+        list->capacity = capacity;
+    }
+
+    list->labels[list->count++] = label;
+    return 1;
+}
+
+static uint32_t find_root(uint32_t *parent, uint32_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+
+    return i;
+}
+
+// Returns 0 if a and b were already connected, which closes a cycle
+static int join(uint32_t *parent, uint32_t a, uint32_t b) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+
+    if (a == b) {
+        return 0;
+    }
+
+    if (a < b) {
+        parent[b] = a;
+    } else {
+        parent[a] = b;
+    }
+
+    return 1;
+}
+
+// Per-thread buffers for one tile
+typedef struct {
+    uint32_t *parent; // Union-find over the runs of the tile
+    uint32_t *label; // Crossing label of each root run
+    uint32_t *previous; // Run of each cell in the row above
+    uint32_t *current; // Run of each cell in this row
+    uint32_t *first_row; // Runs of the tile's top row
+    uint32_t *left_runs; // Run at the left edge of each row
+    uint32_t *right_runs; // Run at the right edge of each row
+} TileScratch;
+
+static uint64_t line_word(const uint64_t *line, size_t word, size_t stride) {
+    return word < stride ? line[word] : 0;
+}
+
+// Bits first..last-1 of a word's 64 cells that lie in [first, last)
+static uint64_t range_mask(int word_start, int first, int last) {
+    uint64_t mask = ~(uint64_t) 0;
+
+    if (first > word_start) {
+        mask &= ~(uint64_t) 0 << (first - word_start);
+    }
+
+    if (last < word_start + 64) {
+        mask &= last <= word_start ? 0 : ~(uint64_t) 0 >> (64 - (last - word_start));
+    }
+
+    return mask;
+}
+
+// Counts passages, dead ends and junctions of 64 cells at once. Each cell's
+// four open sides are added with bit-sliced adders into a 3-bit degree.
+static void count_degrees(const Maze *maze, int y, int word, uint64_t valid, TileResult *result) {
+    size_t stride = maze->stride;
+    const uint64_t *vertical = maze_vertical_line(maze, y);
+    int word_start = word * 64;
+
+    uint64_t left_open = ~vertical[word] & range_mask(word_start, 1, maze->width);
+    uint64_t right_open = ~((vertical[word] >> 1) | (line_word(vertical, word + 1, stride) << 63)) &
+        range_mask(word_start, 0, maze->width - 1);
+    uint64_t top_open = y > 0 ? ~maze_horizontal_line(maze, y)[word] : 0;
+    uint64_t bottom_open = y < maze->height - 1 ? ~maze_horizontal_line(maze, y + 1)[word] : 0;
+
+    left_open &= valid;
+    right_open &= valid;
+    top_open &= valid;
+    bottom_open &= valid;
+
+    uint64_t sum_lr = left_open ^ right_open;
+    uint64_t carry_lr = left_open & right_open;
+    uint64_t sum_tb = top_open ^ bottom_open;
+    uint64_t carry_tb = top_open & bottom_open;
+    uint64_t carry = sum_lr & sum_tb;
+    uint64_t bit0 = sum_lr ^ sum_tb;
+    uint64_t bit1 = carry_lr ^ carry_tb ^ carry;
+    uint64_t bit2 = (carry_lr & carry_tb) | ((carry_lr ^ carry_tb) & carry);
+
+    uint64_t dead_ends = bit0 & ~bit1 & ~bit2;
+    uint64_t junctions = (bit0 & bit1) | bit2;
+
+    // The entrance and exit open to the outside, so they are not dead ends
+    if (y == 0 && word == 0) {
+        dead_ends &= ~(uint64_t) 1;
+    }
+
+    if (y == maze->height - 1 && word == (maze->width - 1) / 64) {
+        dead_ends &= ~((uint64_t) 1 << ((maze->width - 1) & 63));
+    }
+
+    size_t degree_sum = __builtin_popcountll(bit0 & junctions) +
+        2 * __builtin_popcountll(bit1 & junctions) +
+        4 * __builtin_popcountll(bit2 & junctions);
+
+    result->passages += __builtin_popcountll(right_open) + __builtin_popcountll(bottom_open);
+    result->dead_ends += __builtin_popcountll(dead_ends);
+    result->junctions += __builtin_popcountll(junctions);
+    result->branches += degree_sum - __builtin_popcountll(junctions);
+}
+
+static int add_crossing(TileResult *result, TileScratch *scratch, int side, uint32_t run) {
+    uint32_t root = find_root(scratch->parent, run);
+
+    if (scratch->label[root] == UINT32_MAX) {
+        scratch->label[root] = result->labels++;
+    }
+
+    return push_label(&result->crossings[side], scratch->label[root]);
+}
+
+// Labels each row's horizontal runs of connected cells, then joins runs to
+// the row above through open top walls. Tiles start on a word boundary.
+static void validate_tile(const Maze *maze, int tile_x, int tile_y, TileResult *result, TileScratch *scratch) {
+    int x1 = tile_x * VALIDATE_TILE_SIZE;
+    int y1 = tile_y * VALIDATE_TILE_SIZE;
+    int x2 = x1 + VALIDATE_TILE_SIZE < maze->width ? x1 + VALIDATE_TILE_SIZE : maze->width;
+    int y2 = y1 + VALIDATE_TILE_SIZE < maze->height ? y1 + VALIDATE_TILE_SIZE : maze->height;
+    int tile_width = x2 - x1;
+    int first_word = x1 / 64;
+    int last_word = (x2 - 1) / 64;
+    uint32_t runs = 0;
+    size_t joins = 0;
+
+    for (int y = y1; y < y2; y++) {
+        const uint64_t *vertical = maze_vertical_line(maze, y);
+        const uint64_t *top = maze_horizontal_line(maze, y);
+
+        // A wall on the right of a cell starts a new run
+        uint32_t run = runs;
+
+        for (int i = 0; i < tile_width; i++) {
+            scratch->current[i] = run;
+            run += maze_get_bit(vertical, x1 + i + 1);
+        }
+
+        // The wall after the last cell always counts, closed or not
+        run += !maze_get_bit(vertical, x2);
+
+        for (uint32_t r = runs; r < run; r++) {
+            scratch->parent[r] = r;
+            scratch->label[r] = UINT32_MAX;
+        }
+
+        runs = run;
+        scratch->left_runs[y - y1] = scratch->current[0];
+        scratch->right_runs[y - y1] = scratch->current[tile_width - 1];
+
+        for (int word = first_word; word <= last_word; word++) {
+            uint64_t valid = range_mask(word * 64, x1, x2);
+
+            count_degrees(maze, y, word, valid, result);
+
+            if (y == y1) {
+                continue;
+            }
+
+            uint64_t open = ~top[word] & valid;
+
+            while (open) {
+                int i = word * 64 + __builtin_ctzll(open) - x1;
+                open &= open - 1;
+
+                if (join(scratch->parent, scratch->current[i], scratch->previous[i])) {
+                    joins++;
+                } else {
+                    result->cycles++;
+                }
+            }
+        }
+
+        if (y == y1) {
+            memcpy(scratch->first_row, scratch->current, tile_width * sizeof(uint32_t));
+        }
+
+        uint32_t *swap = scratch->previous;
+        scratch->previous = scratch->current;
+        scratch->current = swap;
+    }
+
+    result->components = runs - joins;
+
+    // List the passages that leave the tile, walking each border in order.
+    // The last row's runs are now in previous.
+    for (int k = 0; k < y2 - y1; k++) {
+        int y = y1 + k;
+
+        if (x2 < maze->width && !maze_right(maze, x2 - 1, y) &&
+            !add_crossing(result, scratch, CROSSING_RIGHT, scratch->right_runs[k])) {
+            result->failed = 1;
+        }
+
+        if (x1 > 0 && !maze_left(maze, x1, y) &&
+            !add_crossing(result, scratch, CROSSING_LEFT, scratch->left_runs[k])) {
+            result->failed = 1;
+        }
+    }
+
+    for (int k = 0; k < tile_width; k++) {
+        int x = x1 + k;
+
+        if (y2 < maze->height && !maze_bottom(maze, x, y2 - 1) &&
+            !add_crossing(result, scratch, CROSSING_BOTTOM, scratch->previous[k])) {
+            result->failed = 1;
+        }
+
+        if (y1 > 0 && !maze_top(maze, x, y1) &&
+            !add_crossing(result, scratch, CROSSING_TOP, scratch->first_row[k])) {
+            result->failed = 1;
+        }
+    }
+}
+
+static void *validate_worker(void *arg) {
+    TileWork *work = arg;
+    size_t tile_cells = (size_t) VALIDATE_TILE_SIZE * VALIDATE_TILE_SIZE;
+    size_t row_bytes = VALIDATE_TILE_SIZE * sizeof(uint32_t);
+    TileScratch scratch = {
+        malloc(tile_cells * sizeof(uint32_t)),
+        malloc(tile_cells * sizeof(uint32_t)),
+        malloc(row_bytes),
+        malloc(row_bytes),
+        malloc(row_bytes),
+        malloc(row_bytes),
+        malloc(row_bytes)
+    };
+    int ready = scratch.parent != NULL && scratch.label != NULL && scratch.previous != NULL &&
+        scratch.current != NULL && scratch.first_row != NULL && scratch.left_runs != NULL &&
+        scratch.right_runs != NULL;
+    int tiles = work->tiles_x * work->tiles_y;
+
+    while (1) {
+        int tile = __atomic_fetch_add(&work->next_tile, 1, __ATOMIC_RELAXED);
+
+        if (tile >= tiles) {
+            break;
+        }
+
+        if (!ready) {
+            work->results[tile].failed = 1;
+            continue;
+        }
+
+        validate_tile(work->maze, tile % work->tiles_x, tile / work->tiles_x, &work->results[tile], &scratch);
+    }
+
+    free(scratch.parent);
+    free(scratch.label);
+    free(scratch.previous);
+    free(scratch.current);
+    free(scratch.first_row);
+    free(scratch.left_runs);
+    free(scratch.right_runs);
+
+    return NULL;
+}
+
+// Joins the tile components across every border. Passages between tiles
+// that join components which are already connected are cycles.
+static int merge_tiles(TileWork *work, size_t *components, size_t *cycles) {
+    int tiles = work->tiles_x * work->tiles_y;
+    size_t *first = malloc(tiles * sizeof(size_t));
+    size_t total = 0;
+
+    if (first == NULL) {
+        return 0;
+    }
+
+    for (int t = 0; t < tiles; t++) {
+        first[t] = total;
+        total += work->results[t].labels;
+        *components += work->results[t].components;
+        *cycles += work->results[t].cycles;
+    }
+
+    uint32_t *parent = malloc((total ? total : 1) * sizeof(uint32_t));
+
+    if (parent == NULL || total > UINT32_MAX) {
+        free(first);
+        free(parent);
+        return 0;
+    }
+
+    for (size_t i = 0; i < total; i++) {
+        parent[i] = i;
+    }
+
+    for (int t = 0; t < tiles; t++) {
+        int tile_x = t % work->tiles_x;
+        int tile_y = t / work->tiles_x;
+
+        for (int side = CROSSING_RIGHT; side <= CROSSING_BOTTOM; side++) {
+            int neighbour = side == CROSSING_RIGHT ? t + 1 : t + work->tiles_x;
+            int exists = side == CROSSING_RIGHT ? tile_x + 1 < work->tiles_x : tile_y + 1 < work->tiles_y;
+
+            if (!exists) {
+                continue;
+            }
+
+            LabelList *near_side = &work->results[t].crossings[side];
+            LabelList *far_side = &work->results[neighbour].crossings[side + 2];
+
+            for (size_t k = 0; k < near_side->count && k < far_side->count; k++) {
+                if (join(parent, first[t] + near_side->labels[k], first[neighbour] + far_side->labels[k])) {
+                    (*components)--;
+                } else {
+                    (*cycles)++;
+                }
+            }
+        }
+    }
+
+    free(first);
+    free(parent);
+
+    return 1;
+}
+
+static int border_closed(const Maze *maze) {
+    for (int x = 0; x < maze->width; x++) {
+        if (!maze_top(maze, x, 0) || !maze_bottom(maze, x, maze->height - 1)) {
+            return 0;
+        }
+    }
+
+    for (int y = 0; y < maze->height; y++) {
+        if ((y != 0 && !maze_left(maze, 0, y)) ||
+            (y != maze->height - 1 && !maze_right(maze, maze->width - 1, y))) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+typedef struct {
+    uint64_t *cells;
+    size_t count;
+    size_t capacity;
+} CellList;
+
+static int push_cell(CellList *list, uint64_t cell) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        uint64_t *cells = realloc(list->cells, capacity * sizeof(uint64_t));
+
+        if (cells == NULL) {
+            return 0;
+        }
+
+        list->cells = cells;
+        list->capacity = capacity;
+    }
+
+    list->cells[list->count++] = cell;
+    return 1;
+}
+
+// Breadth-first search one level at a time, only the frontier is stored
+static long solution_length(const Maze *maze) {
+    int width = maze->width;
+    uint64_t cells = (uint64_t) width * maze->height;
+    uint64_t goal = cells - 1;
+    uint64_t *visited = calloc((cells + 63) / 64, sizeof(uint64_t));
+    CellList current = { NULL, 0, 0 };
+    CellList next = { NULL, 0, 0 };
+    long length = -1;
+
+    if (visited == NULL || !push_cell(&current, 0)) {
+        goto done;
+    }
+
+    visited[0] = 1;
+
+    for (long level = 1; current.count > 0; level++) {
+        next.count = 0;
+
+        for (size_t i = 0; i < current.count; i++) {
+            uint64_t cell = current.cells[i];
+
+            if (cell == goal) {
+                length = level;
+                goto done;
+            }
+
+            int x = cell % width;
+            int y = cell / width;
+            uint64_t neighbours[4];
+            int count = 0;
+
+            if (x > 0 && !maze_left(maze, x, y)) {
+                neighbours[count++] = cell - 1;
+            }
+
+            if (x < width - 1 && !maze_right(maze, x, y)) {
+                neighbours[count++] = cell + 1;
+            }
+
+            if (y > 0 && !maze_top(maze, x, y)) {
+                neighbours[count++] = cell - width;
+            }
+
+            if (y < maze->height - 1 && !maze_bottom(maze, x, y)) {
+                neighbours[count++] = cell + width;
+            }
+
+            for (int n = 0; n < count; n++) {
+                uint64_t neighbour = neighbours[n];
+                uint64_t mask = (uint64_t) 1 << (neighbour & 63);
+
+                if (visited[neighbour >> 6] & mask) {
+                    continue;
+                }
+
+                visited[neighbour >> 6] |= mask;
+
+                if (!push_cell(&next, neighbour)) {
+                    goto done;
+                }
+            }
+        }
+
+        CellList swap = current;
+        current = next;
+        next = swap;
+    }
+
+done:
+    free(visited);
+    free(current.cells);
+    free(next.cells);
+
+    return length;
+}
+
+int validate_maze(const Maze *maze, int threads, MazeReport *report) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (threads <= 0) {
+        threads = default_thread_count();
+    }
+
+    TileWork work;
+    work.maze = maze;
+    work.tiles_x = (maze->width + VALIDATE_TILE_SIZE - 1) / VALIDATE_TILE_SIZE;
+    work.tiles_y = (maze->height + VALIDATE_TILE_SIZE - 1) / VALIDATE_TILE_SIZE;
+    work.next_tile = 0;
+
+    int tiles = work.tiles_x * work.tiles_y;
+    work.results = calloc(tiles, sizeof(TileResult));
+
+    if (work.results == NULL) {
+        return 0;
+    }
+
+    if (threads > tiles) {
+        threads = tiles;
+    }
+
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+
+    if (workers != NULL) {
+        for (; started < threads; started++) {
+            if (pthread_create(&workers[started], NULL, validate_worker, &work) != 0) {
+                break;
+            }
+        }
+    }
+
+    // Validate on this thread if no worker could start
+    if (started == 0) {
+        validate_worker(&work);
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+
+    memset(report, 0, sizeof(MazeReport));
+    report->width = maze->width;
+    report->height = maze->height;
+    report->threads = started > 0 ? started : 1;
+
+    int ok = 1;
+
+    for (int t = 0; t < tiles; t++) {
+        TileResult *result = &work.results[t];
+
+        if (result->failed) {
+            ok = 0;
+        }
+
+        report->passages += result->passages;
+        report->dead_ends += result->dead_ends;
+        report->junctions += result->junctions;
+        report->branching_factor += result->branches;
+    }
+
+    if (ok) {
+        ok = merge_tiles(&work, &report->components, &report->cycles);
+    }
+
+    for (int t = 0; t < tiles; t++) {
+        for (int side = 0; side < 4; side++) {
+            free(work.results[t].crossings[side].labels);
+        }
+    }
+
+    free(work.results);
+
+    if (!ok) {
+        return 0;
+    }
+
+    if (report->junctions > 0) {
+        report->branching_factor /= report->junctions;
+    }
+
+    report->entrance_open = !maze_left(maze, 0, 0);
+    report->exit_open = !maze_right(maze, maze->width - 1, maze->height - 1);
+    report->border_closed = border_closed(maze);
+    report->perfect = report->components == 1 && report->cycles == 0 &&
+        report->entrance_open && report->exit_open && report->border_closed;
+    report->validate_seconds = seconds_since(start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    report->solution_length = solution_length(maze);
+    report->solve_seconds = seconds_since(start);
+
+    return 1;
+}
+
+static const char *json_bool(int value) {
+    return value ? "true" : "false";
+}
+
+void write_report_json(FILE *file, const MazeReport *report) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"width\": %d,\n", report->width);
+    fprintf(file, "  \"height\": %d,\n", report->height);
+    fprintf(file, "  \"cells\": %zu,\n", (size_t) report->width * report->height);
+    fprintf(file, "  \"seed\": %llu,\n", (unsigned long long) report->seed);
+    fprintf(file, "  \"generator\": %d,\n", report->generator);
+    fprintf(file, "  \"perfect\": %s,\n", json_bool(report->perfect));
+    fprintf(file, "  \"components\": %zu,\n", report->components);
+    fprintf(file, "  \"cycles\": %zu,\n", report->cycles);
+    fprintf(file, "  \"entrance_open\": %s,\n", json_bool(report->entrance_open));
+    fprintf(file, "  \"exit_open\": %s,\n", json_bool(report->exit_open));
+    fprintf(file, "  \"border_closed\": %s,\n", json_bool(report->border_closed));
+    fprintf(file, "  \"passages\": %zu,\n", report->passages);
+    fprintf(file, "  \"dead_ends\": %zu,\n", report->dead_ends);
+    fprintf(file, "  \"junctions\": %zu,\n", report->junctions);
+    fprintf(file, "  \"branching_factor\": %.4f,\n", report->branching_factor);
+    fprintf(file, "  \"solution_length\": %ld,\n", report->solution_length);
+    fprintf(file, "  \"threads\": %d,\n", report->threads);
+    fprintf(file, "  \"validate_seconds\": %.6f,\n", report->validate_seconds);
+    fprintf(file, "  \"solve_seconds\": %.6f\n", report->solve_seconds);
+    fprintf(file, "}\n");
+}
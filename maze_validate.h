@@ -0,0 +1,40 @@
+#ifndef MAZE_VALIDATE_H
+#define MAZE_VALIDATE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "maze_algorithms.h"
+
+// Cells per side of the tiles validated in parallel
+#define VALIDATE_TILE_SIZE 256
+
+typedef struct {
+    int width;
+    int height;
+    uint64_t seed;
+    int generator;
+
+    // Validation
+    int perfect; // Connected, no cycles, open entrance and exit, closed border
+    size_t components;
+    size_t cycles;
+    int entrance_open;
+    int exit_open;
+    int border_closed;
+
+    // Statistics
+    size_t passages; // Open walls between two cells
+    size_t dead_ends; // Cells with one passage, not counting the entrance and exit
+    size_t junctions; // Cells with three or more passages
+    double branching_factor; // Average onward choices at a junction
+    long solution_length; // Cells on the shortest path, -1 if there is none
+
+    int threads;
+    double validate_seconds;
+    double solve_seconds;
+} MazeReport;
+
+int validate_maze(const Maze *maze, int threads, MazeReport *report);
+void write_report_json(FILE *file, const MazeReport *report);
+
+#endif
@@ -0,0 +1,43 @@
+#include <stdlib.h>
+#include <errno.h>
+#include "rng.h"
+
+// splitmix64 finalizer, used to expand seeds and mix stream keys
+uint64_t rng_mix(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+    return value ^ (value >> 31);
+}
+
+// Combines a domain id and two coordinates into a stream key
+uint64_t rng_key(uint64_t domain, int a, int b) {
+    return rng_mix(domain ^ rng_mix(((uint64_t) (uint32_t) a << 32) | (uint32_t) b));
+}
+
+void rng_init(Rng *rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        seed = rng_mix(seed);
+        rng->s[i] = seed;
+    }
+}
+
+void rng_init_stream(Rng *rng, uint64_t seed, uint64_t stream) {
+    rng_init(rng, seed ^ rng_mix(stream));
+}
+
+// Draws a seed for a child stream that is independent of the parent
+uint64_t rng_split(Rng *rng) {
+    return rng_mix(rng_next(rng));
+}
+
+uint64_t parse_seed(const char *text, int *ok) {
+    char *end;
+
+    errno = 0;
+    uint64_t seed = strtoull(text, &end, 0);
+    *ok = errno == 0 && end != text && *end == '\0';
+
+    return seed;
+}
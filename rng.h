@@ -0,0 +1,56 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// xoshiro256** generator. Each Rng is an independent stream, so threads
+// never share state and results do not depend on scheduling.
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+uint64_t rng_mix(uint64_t value);
+uint64_t rng_key(uint64_t domain, int a, int b);
+void rng_init(Rng *rng, uint64_t seed);
+void rng_init_stream(Rng *rng, uint64_t seed, uint64_t stream);
+uint64_t rng_split(Rng *rng);
+uint64_t parse_seed(const char *text, int *ok);
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(Rng *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+
+    return result;
+}
+
+// Uniform integer in [0, bound), bound > 0
+static inline uint32_t rng_below(Rng *rng, uint32_t bound) {
+    uint64_t product = (rng_next(rng) >> 32) * bound;
+    uint32_t low = (uint32_t) product;
+
+    // Reject the few values that would bias the result
+    if (low < bound) {
+        uint32_t threshold = -bound % bound;
+
+        while (low < threshold) {
+            product = (rng_next(rng) >> 32) * bound;
+            low = (uint32_t) product;
+        }
+    }
+
+    return product >> 32;
+}
+
+#endif
@@ -1,24 +1,46 @@
 #version 120
 
-attribute vec4 vPosition;
-attribute vec4 vNormal;
-attribute vec2 vTexCoord;
+attribute vec3 vPosition;
+attribute vec2 vFaceTile; // Face 0-5 (+x, -x, +y, -y, +z, -z) and atlas tile
+attribute vec4 vInstance; // Block position and id when drawing instances
 
 varying vec2 texCoord;
+varying vec2 tile;
 varying vec4 N, V, L;
 varying float distance;
 
 uniform mat4 ctm, model_view, projection;
 
 uniform vec4 light_position;
+uniform float tex_size;
+uniform int instanced;
+uniform float block_tiles[36]; // Atlas tile of each face of each block id, BLOCK_COUNT * 6
 
 void main()
 {
-    N = normalize(model_view * ctm * vNormal);
-    L = normalize(model_view * (light_position - ctm * vPosition));
-    V = normalize(vec4(0, 0, 0, 1) - (model_view * ctm * vPosition));
+    vec3 block_position = vPosition;
+    float tile_index = vFaceTile.y;
 
-    texCoord = vTexCoord;
-    gl_Position = projection * model_view * ctm * vPosition;
-    distance = length(model_view * (light_position - ctm * vPosition));
+    if (instanced == 1) {
+        block_position += vInstance.xyz;
+        tile_index = block_tiles[int(vInstance.w) * 6 + int(vFaceTile.x)];
+    }
+
+    vec4 position = vec4(block_position, 1.0);
+    float axis = floor(vFaceTile.x / 2.0);
+    float side = 1.0 - 2.0 * (vFaceTile.x - 2.0 * axis);
+    vec4 normal = vec4(side * vec3(axis == 0.0, axis == 1.0, axis == 2.0), 1.0);
+
+    N = normalize(model_view * ctm * normal);
+    L = normalize(model_view * (light_position - ctm * position));
+    V = normalize(vec4(0, 0, 0, 1) - (model_view * ctm * position));
+
+    // Textures run against the axes along a face and repeat once per block
+    texCoord = -(axis == 0.0 ? block_position.zy : axis == 1.0 ? block_position.xz : block_position.xy);
+
+    float tiles_per_row = floor(1.0 / tex_size + 0.5);
+    tile = vec2(mod(tile_index, tiles_per_row), floor(tile_index / tiles_per_row));
+
+    gl_Position = projection * model_view * ctm * position;
+    distance = length(model_view * (light_position - ctm * position));
 }
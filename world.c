@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include "world.h"
+
+_Static_assert(BLOCK_COUNT <= SECTION_PALETTE_MAX, "every block id must fit in one section palette");
+
+// Step to the neighbour each face looks at
+const int FACE_OFFSETS[6][3] = {
+    { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+};
+
+// Covers min to max inclusive on each axis, all air. Returns 0 when out of memory.
+int world_create(World *world, int min_x, int min_y, int min_z, int max_x, int max_y, int max_z) {
+    world->min_x = min_x;
+    world->min_y = min_y;
+    world->min_z = min_z;
+    world->size_x = max_x - min_x + 1;
+    world->size_y = max_y - min_y + 1;
+    world->size_z = max_z - min_z + 1;
+    world->sections_x = (world->size_x + SECTION_SIZE - 1) >> SECTION_SHIFT;
+    world->sections_y = (world->size_y + SECTION_SIZE - 1) >> SECTION_SHIFT;
+    world->sections_z = (world->size_z + SECTION_SIZE - 1) >> SECTION_SHIFT;
+
+    size_t count = (size_t) world->sections_x * world->sections_y * world->sections_z;
+
+    world->sections = calloc(count, sizeof(WorldSection));
+
+    if (world->sections == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        world->sections[i].palette_size = 1; // Air
+    }
+
+    return 1;
+}
+
+void world_free(World *world) {
+    size_t count = (size_t) world->sections_x * world->sections_y * world->sections_z;
+
+    for (size_t i = 0; i < count && world->sections != NULL; i++) {
+        free(world->sections[i].indices);
+    }
+
+    free(world->sections);
+    world->sections = NULL;
+}
+
+// Doubles the bits per index, or goes from none to one
+static int widen_section(WorldSection *section) {
+    int bits = section->bits == 0 ? 1 : section->bits * 2;
+    uint64_t *indices = calloc(SECTION_BLOCKS * bits / 64, sizeof(uint64_t));
+
+    if (indices == NULL) {
+        return 0;
+    }
+
+    // Palette entries keep their number, only their width changes
+    for (size_t i = 0; section->bits > 0 && i < SECTION_BLOCKS; i++) {
+        size_t bit = i * section->bits;
+        uint64_t entry = section->indices[bit >> 6] >> (bit & 63) & ((1 << section->bits) - 1);
+
+        indices[i * bits >> 6] |= entry << (i * bits & 63);
+    }
+
+    free(section->indices);
+    section->indices = indices;
+    section->bits = bits;
+
+    return 1;
+}
+
+// Blocks outside the world are ignored. Returns 0 when out of memory.
+// Sections are not locked, threads must write to different sections.
+int world_set(World *world, int x, int y, int z, int block) {
+    if (!world_contains(world, x, y, z)) {
+        return 1;
+    }
+
+    size_t index;
+    WorldSection *section = world_section(world, x, y, z, &index);
+    int entry = 0;
+
+    while (entry < section->palette_size && section->palette[entry] != block) {
+        entry++;
+    }
+
+    if (entry == section->palette_size) {
+        if (entry == 1 << section->bits && !widen_section(section)) {
+            return 0;
+        }
+
+        section->palette[section->palette_size++] = block;
+    }
+
+    if (section->bits > 0) {
+        size_t bit = index * section->bits;
+        uint64_t mask = (uint64_t) ((1 << section->bits) - 1) << (bit & 63);
+
+        section->indices[bit >> 6] = (section->indices[bit >> 6] & ~mask) | (uint64_t) entry << (bit & 63);
+    }
+
+    return 1;
+}
+
+// Bytes held by the sections and their indices
+size_t world_memory(const World *world) {
+    size_t count = (size_t) world->sections_x * world->sections_y * world->sections_z;
+    size_t bytes = count * sizeof(WorldSection);
+
+    for (size_t i = 0; i < count; i++) {
+        bytes += SECTION_BLOCKS / 8 * world->sections[i].bits;
+    }
+
+    return bytes;
+}
@@ -0,0 +1,116 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Block ids stored in the world, 0 is air
+#define BLOCK_AIR 0
+#define BLOCK_GRASS 1
+#define BLOCK_DIRT 2
+#define BLOCK_BIRCH_PLANKS 3
+#define BLOCK_BRICKS 4
+#define BLOCK_STONE_BRICKS 5
+#define BLOCK_COUNT 6
+
+// Faces of a block, in the order of the fields of Block
+#define FACE_X_POS 0
+#define FACE_X_NEG 1
+#define FACE_Y_POS 2
+#define FACE_Y_NEG 3
+#define FACE_Z_POS 4
+#define FACE_Z_NEG 5
+
+// The world is stored in cubes of 16 x 16 x 16 blocks
+#define SECTION_SHIFT 4
+#define SECTION_SIZE (1 << SECTION_SHIFT)
+#define SECTION_BLOCKS (SECTION_SIZE * SECTION_SIZE * SECTION_SIZE)
+#define SECTION_PALETTE_MAX 16
+
+// Blocks of a section as indices into its palette, packed bits to an index.
+// A section of one block has no indices at all.
+typedef struct {
+    uint64_t *indices; // x fastest, then z, then y
+    uint8_t bits; // 0, 1, 2 or 4
+    uint8_t palette_size;
+    uint8_t palette[SECTION_PALETTE_MAX]; // Block ids
+} WorldSection;
+
+// Block ids of a box of the world. Blocks outside the box are air and
+// cannot be set. Sections counted from the minimum of the box.
+typedef struct {
+    int min_x;
+    int min_y;
+    int min_z;
+    int size_x;
+    int size_y;
+    int size_z;
+    int sections_x;
+    int sections_y;
+    int sections_z;
+    WorldSection *sections; // x fastest, then z, then y
+} World;
+
+extern const int FACE_OFFSETS[6][3];
+
+int world_create(World *world, int min_x, int min_y, int min_z, int max_x, int max_y, int max_z);
+void world_free(World *world);
+int world_set(World *world, int x, int y, int z, int block);
+size_t world_memory(const World *world);
+
+static inline int world_contains(const World *world, int x, int y, int z) {
+    return (unsigned) (x - world->min_x) < (unsigned) world->size_x &&
+        (unsigned) (y - world->min_y) < (unsigned) world->size_y &&
+        (unsigned) (z - world->min_z) < (unsigned) world->size_z;
+}
+
+// Section holding a block inside the world, and the block's place in it
+static inline WorldSection *world_section(const World *world, int x, int y, int z, size_t *index) {
+    x -= world->min_x;
+    y -= world->min_y;
+    z -= world->min_z;
+
+    *index = ((size_t) (y & (SECTION_SIZE - 1)) << (2 * SECTION_SHIFT)) |
+        ((size_t) (z & (SECTION_SIZE - 1)) << SECTION_SHIFT) | (x & (SECTION_SIZE - 1));
+
+    return &world->sections[((size_t) (y >> SECTION_SHIFT) * world->sections_z + (z >> SECTION_SHIFT)) *
+        world->sections_x + (x >> SECTION_SHIFT)];
+}
+
+static inline int section_get(const WorldSection *section, size_t index) {
+    if (section->bits == 0) {
+        return section->palette[0];
+    }
+
+    size_t bit = index * section->bits;
+    int entry = section->indices[bit >> 6] >> (bit & 63) & ((1 << section->bits) - 1);
+
+    return section->palette[entry];
+}
+
+static inline int world_get(const World *world, int x, int y, int z) {
+    if (!world_contains(world, x, y, z)) {
+        return BLOCK_AIR;
+    }
+
+    size_t index;
+    const WorldSection *section = world_section(world, x, y, z, &index);
+
+    return section_get(section, index);
+}
+
+// Bit i is set when face i of the block at (x, y, z) borders air
+static inline int world_visible_faces(const World *world, int x, int y, int z) {
+    int faces = 0;
+
+    for (int face = 0; face < 6; face++) {
+        if (world_get(world, x + FACE_OFFSETS[face][0], y + FACE_OFFSETS[face][1], z + FACE_OFFSETS[face][2]) ==
+            BLOCK_AIR) {
+            faces |= 1 << face;
+        }
+    }
+
+    return faces;
+}
+
+#endif